@@ -0,0 +1,156 @@
+/*
+ * Accept thundering herd across processes.  Each worker forks its own
+ * event_base and watches one shared listening socket; the parent makes
+ * connections one at a time, waiting for each to be accepted so every
+ * connection finds all workers asleep.  A callback whose accept4() finds
+ * nothing is wasted.  Workers that the kernel wakes but that find the
+ * socket already drained go back to sleep inside epoll_wait without a
+ * callback, so the workers' voluntary context switches are counted too:
+ *
+ *	bench_accept.out [nworkers [nconns]]
+ *
+ * Run once with plain EV_READ and once with EV_EXCLUSIVE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "event.h"
+
+
+
+static int nworkers = 8, nconns = 2000;
+
+/* shared with the workers */
+struct counts {
+	volatile int accepted;
+	volatile int callbacks;
+	volatile int wasted;
+};
+static struct counts *counts;
+
+
+static void
+accept_cb(int fd, short what, void *arg)
+{
+	int conn;
+
+	__atomic_add_fetch(&counts->callbacks, 1, __ATOMIC_RELAXED);
+	conn = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
+	if (conn == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			__atomic_add_fetch(&counts->wasted, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	close(conn);
+	__atomic_add_fetch(&counts->accepted, 1, __ATOMIC_RELEASE);
+}
+
+static void
+worker(int listener, short flags)
+{
+	struct event_base *base;
+	struct event ev;
+
+	base = event_base_new();
+	event_set(&ev, listener, EV_READ | EV_PERSIST | flags, accept_cb,
+	    NULL);
+	event_base_set(base, &ev);
+	event_add(&ev, NULL);
+	event_base_loop(base, 0);
+	_exit(0);
+}
+
+static void
+run(int listener, struct sockaddr_in *sin, short flags, const char *name)
+{
+	struct rusage ru0, ru1;
+	pid_t *pids;
+	int i, fd;
+
+	memset(counts, 0, sizeof(*counts));
+	getrusage(RUSAGE_CHILDREN, &ru0);
+	pids = calloc(nworkers, sizeof(pid_t));
+	for (i = 0; i < nworkers; i++) {
+		if ((pids[i] = fork()) == 0)
+			worker(listener, flags);
+	}
+	/* give every worker time to block in epoll_wait */
+	usleep(100000);
+
+	for (i = 0; i < nconns; i++) {
+		if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+		    connect(fd, (struct sockaddr *)sin, sizeof(*sin)) == -1) {
+			perror("connect");
+			exit(1);
+		}
+		while (__atomic_load_n(&counts->accepted, __ATOMIC_ACQUIRE) <=
+		    i)
+			usleep(10);
+		close(fd);
+	}
+	/* let the losers of the last race finish their wakeup */
+	usleep(100000);
+
+	for (i = 0; i < nworkers; i++) {
+		kill(pids[i], SIGTERM);
+		waitpid(pids[i], NULL, 0);
+	}
+	free(pids);
+	getrusage(RUSAGE_CHILDREN, &ru1);
+
+	printf("%-12s %8d callbacks %6d wasted %8.2f switches/conn\n", name,
+	    counts->callbacks, counts->wasted,
+	    (double)(ru1.ru_nvcsw - ru0.ru_nvcsw) / nconns);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int listener;
+
+	if (argc > 1)
+		nworkers = atoi(argv[1]);
+	if (argc > 2)
+		nconns = atoi(argv[2]);
+	if (nworkers < 1 || nconns < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return (1);
+	}
+
+	counts = mmap(NULL, sizeof(*counts), PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (counts == MAP_FAILED) {
+		perror("mmap");
+		return (1);
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (listener == -1 ||
+	    bind(listener, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(listener, 128) == -1 ||
+	    getsockname(listener, (struct sockaddr *)&sin, &len) == -1) {
+		perror("listen");
+		return (1);
+	}
+
+	printf("%d workers, %d connections\n", nworkers, nconns);
+	run(listener, &sin, 0, "EV_READ");
+	run(listener, &sin, EV_EXCLUSIVE, "EV_EXCLUSIVE");
+	return (0);
+}
@@ -0,0 +1,164 @@
+/*
+ * Compare the epoll and io_uring backends on the classic libevent bench:
+ * a chain of socketpairs where each read callback forwards one byte to
+ * the next pair, with every event deleted and re-added between rounds.
+ *
+ *	bench_backend.out [npairs [nactive [nwrites [rounds]]]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "event.h"
+
+
+
+static int npairs = 100, nactive = 1, nwrites = 100, rounds = 25;
+static int count, writes, fired;
+static int *pairs;
+static struct event *events;
+static int armed;
+
+
+static void
+read_cb(int fd, short which, void *arg)
+{
+	long idx = (long)arg, widx = idx + 1;
+	char ch;
+
+	if (recv(fd, &ch, 1, 0) == 1)
+		count++;
+	else
+		return;
+	if (writes) {
+		if (widx >= npairs)
+			widx -= npairs;
+		send(pairs[2 * widx + 1], "e", 1, 0);
+		writes--;
+		fired++;
+	}
+}
+
+static double
+run_once(struct event_base *base)
+{
+	struct timespec t0, t1;
+	struct timeval tv = { 60, 0 };
+	int i, space;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	/* the interest churn the backends are meant to absorb */
+	for (i = 0; i < npairs; i++) {
+		if (armed)
+			event_del(&events[i]);
+		event_set(&events[i], pairs[2 * i], EV_READ | EV_PERSIST,
+		    read_cb, (void *)(long)i);
+		event_base_set(base, &events[i]);
+		event_add(&events[i], &tv);
+	}
+	armed = 1;
+
+	event_base_loop(base, EVLOOP_ONCE | EVLOOP_NONBLOCK);
+
+	fired = 0;
+	space = npairs / nactive;
+	space = space * 2;
+	for (i = 0; i < nactive; i++, fired++)
+		send(pairs[i * space + 1], "e", 1, 0);
+
+	count = 0;
+	writes = nwrites;
+	do {
+		event_base_loop(base, EVLOOP_ONCE | EVLOOP_NONBLOCK);
+	} while (count != fired);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0.tv_sec) * 1e6 +
+	    (t1.tv_nsec - t0.tv_nsec) / 1e3);
+}
+
+static void
+run(const char *name)
+{
+	struct event_base *base;
+	unsigned long calls;
+	double usec = 0;
+	int i;
+
+	if ((base = event_base_new()) == NULL) {
+		fprintf(stderr, "%s: no backend\n", name);
+		return;
+	}
+	if (strcmp(event_base_get_method(base), name) != 0) {
+		fprintf(stderr, "%s: not available, got %s\n", name,
+		    event_base_get_method(base));
+		event_base_free(base);
+		return;
+	}
+	armed = 0;
+
+	run_once(base);		/* warm up */
+	calls = event_base_get_backend_syscalls(base);
+	for (i = 0; i < rounds; i++)
+		usec += run_once(base);
+	calls = event_base_get_backend_syscalls(base) - calls;
+
+	for (i = 0; i < npairs; i++)
+		event_del(&events[i]);
+	event_base_free(base);
+
+	printf("%-10s %10.1f us/round %12.1f syscalls/round\n",
+	    name, usec / rounds, (double)calls / rounds);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rlimit rl;
+	int i;
+
+	if (argc > 1)
+		npairs = atoi(argv[1]);
+	if (argc > 2)
+		nactive = atoi(argv[2]);
+	if (argc > 3)
+		nwrites = atoi(argv[3]);
+	if (argc > 4)
+		rounds = atoi(argv[4]);
+	if (npairs < 1 || nactive < 1 || nactive > npairs || rounds < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return (1);
+	}
+
+	rl.rlim_cur = rl.rlim_max = npairs * 2 + 64;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == -1)
+		perror("setrlimit");
+
+	pairs = calloc(npairs * 2, sizeof(int));
+	events = calloc(npairs, sizeof(struct event));
+	if (pairs == NULL || events == NULL) {
+		perror("calloc");
+		return (1);
+	}
+	for (i = 0; i < npairs; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, &pairs[2 * i]) == -1) {
+			perror("socketpair");
+			return (1);
+		}
+		fcntl(pairs[2 * i], F_SETFL, O_NONBLOCK);
+	}
+
+	printf("%d pairs, %d active, %d writes, %d rounds\n",
+	    npairs, nactive, nwrites, rounds);
+	run("epoll");
+	setenv("EVENT_NOEPOLL", "1", 1);
+	run("io_uring");
+	return (0);
+}
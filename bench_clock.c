@@ -0,0 +1,68 @@
+/*
+ * Cost of the clock behind event_add(): outside the loop nothing is
+ * cached, so every add of a timer reads the base's clock source.
+ *
+ *	bench_clock.out [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "event.h"
+
+
+
+static int iterations = 1000000;
+
+
+static void
+timer_cb(int fd, short what, void *arg)
+{
+}
+
+static void
+run(const char *name, int source)
+{
+	struct event_base *base;
+	struct event ev;
+	struct timeval tv = { 10, 0 };
+	struct timespec t0, t1;
+	double nsec;
+	int i;
+
+	base = event_base_new();
+	if (event_base_set_clock(base, source) == -1) {
+		printf("%-10s not available\n", name);
+		event_base_free(base);
+		return;
+	}
+	evtimer_set(&ev, timer_cb, NULL);
+	event_base_set(base, &ev);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < iterations; i++) {
+		evtimer_add(&ev, &tv);
+		evtimer_del(&ev);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	nsec = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	printf("%-10s %6.1f ns per add/del\n", name, nsec / iterations);
+	event_base_free(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (iterations < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return (1);
+	}
+
+	run("monotonic", EVENT_CLOCK_MONOTONIC);
+	run("coarse", EVENT_CLOCK_COARSE);
+	run("tsc", EVENT_CLOCK_TSC);
+	return (0);
+}
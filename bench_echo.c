@@ -0,0 +1,163 @@
+/*
+ * Echo throughput of a reactor pool as it grows from 1 to N reactors.
+ * Client threads each keep one connection doing 64-byte ping-pongs:
+ *
+ *	bench_echo.out [max_reactors [nclients [seconds]]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "event.h"
+#include "reactor.h"
+
+
+
+#define MSGLEN	64
+
+struct conn {
+	struct event ev;
+	char buf[4096];
+};
+
+static struct sockaddr_in sin;
+static volatile int stop;
+static int seconds = 2;
+
+
+static void
+echo_cb(int fd, short what, void *arg)
+{
+	struct conn *c = arg;
+	ssize_t n;
+
+	n = recv(fd, c->buf, sizeof(c->buf), 0);
+	if (n > 0) {
+		send(fd, c->buf, n, 0);
+		return;
+	}
+	if (n == -1 && errno == EAGAIN)
+		return;
+	event_del(&c->ev);
+	close(fd);
+	free(c);
+}
+
+static void
+accept_cb(struct event_base *base, int fd, void *arg)
+{
+	struct conn *c;
+	int on = 1;
+
+	if ((c = malloc(sizeof(struct conn))) == NULL) {
+		close(fd);
+		return;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	event_set(&c->ev, fd, EV_READ | EV_PERSIST, echo_cb, c);
+	event_base_set(base, &c->ev);
+	event_add(&c->ev, NULL);
+}
+
+static void *
+client(void *arg)
+{
+	long *count = arg;
+	char buf[MSGLEN];
+	int fd, on = 1;
+	ssize_t n, got;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		return (NULL);
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		close(fd);
+		return (NULL);
+	}
+	memset(buf, 'x', sizeof(buf));
+	while (!stop) {
+		if (send(fd, buf, sizeof(buf), 0) != sizeof(buf))
+			break;
+		for (got = 0; got < MSGLEN; got += n)
+			if ((n = recv(fd, buf + got, MSGLEN - got, 0)) <= 0)
+				goto out;
+		(*count)++;
+	}
+out:
+	close(fd);
+	return (NULL);
+}
+
+static double
+run(int nreactors, int nclients)
+{
+	struct reactor_pool *pool;
+	pthread_t *threads;
+	long *counts, total = 0;
+	int i;
+
+	pool = reactor_pool_new(nreactors, (struct sockaddr *)&sin,
+	    sizeof(sin), accept_cb, NULL);
+	if (pool == NULL || reactor_pool_start(pool) == -1) {
+		fprintf(stderr, "cannot start %d reactors\n", nreactors);
+		exit(1);
+	}
+
+	threads = calloc(nclients, sizeof(pthread_t));
+	counts = calloc(nclients, sizeof(long));
+	stop = 0;
+	for (i = 0; i < nclients; i++)
+		pthread_create(&threads[i], NULL, client, &counts[i]);
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nclients; i++) {
+		pthread_join(threads[i], NULL);
+		total += counts[i];
+	}
+
+	/* let the servers see the EOFs and free their connections */
+	usleep(100000);
+	reactor_pool_free(pool);
+	free(threads);
+	free(counts);
+	return ((double)total / seconds);
+}
+
+int
+main(int argc, char **argv)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int max_reactors = ncpus > 0 ? ncpus : 1;
+	int nclients, n;
+	double rate, base_rate = 0;
+
+	if (argc > 1)
+		max_reactors = atoi(argv[1]);
+	nclients = argc > 2 ? atoi(argv[2]) : 4 * max_reactors;
+	if (argc > 3)
+		seconds = atoi(argv[3]);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(40713);
+
+	for (n = 1; n <= max_reactors; n *= 2) {
+		rate = run(n, nclients);
+		if (n == 1)
+			base_rate = rate;
+		printf("%3d reactors, %3d clients: %10.0f round trips/s (%.2fx)\n",
+		    n, nclients, rate, rate / base_rate);
+		if (n < max_reactors && n * 2 > max_reactors)
+			n = max_reactors / 2;
+	}
+	return (0);
+}
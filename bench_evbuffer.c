@@ -0,0 +1,69 @@
+/*
+ * Streaming through an evbuffer: a producer appends fixed-size messages
+ * and a consumer drains a smaller amount per step, so the buffer holds a
+ * steady backlog as it would for a slow peer.  Reports the cost per byte
+ * moved for a few backlog sizes:
+ *
+ *	bench_evbuffer.out [megabytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "buffer.h"
+
+
+
+#define MSGLEN		1400
+#define DRAINLEN	1000
+
+static size_t total = 256 << 20;
+
+
+static void
+run(size_t backlog)
+{
+	struct evbuffer *buf;
+	struct timespec t0, t1;
+	char msg[MSGLEN];
+	size_t moved = 0;
+	double nsec;
+
+	memset(msg, 'x', sizeof(msg));
+	buf = evbuffer_new();
+	while (EVBUFFER_LENGTH(buf) < backlog)
+		evbuffer_add(buf, msg, sizeof(msg));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while (moved < total) {
+		evbuffer_add(buf, msg, sizeof(msg));
+		while (EVBUFFER_LENGTH(buf) > backlog) {
+			evbuffer_drain(buf, DRAINLEN);
+			moved += DRAINLEN;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	nsec = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	printf("backlog %8zu KiB: %6.3f ns/byte\n", backlog >> 10,
+	    nsec / moved);
+	evbuffer_free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 1)
+		total = (size_t)atoi(argv[1]) << 20;
+	if (total == 0) {
+		fprintf(stderr, "bad arguments\n");
+		return (1);
+	}
+
+	run(4 << 10);
+	run(64 << 10);
+	run(1 << 20);
+	run(4 << 20);
+	return (0);
+}
@@ -0,0 +1,124 @@
+/*
+ * push/erase/pop throughput of the binary min-heap against the 4-ary
+ * heap with inline deadline keys:
+ *
+ *	bench_heap.out [nevents]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "min_heap.h"
+#include "min_heap4.h"
+
+
+
+static int nevent = 1000000;
+static struct event *ev;
+
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+set_random_timeout(struct event *e)
+{
+	e->ev_timeout.tv_sec = random() % 3600;
+	e->ev_timeout.tv_usec = random() % 1000000;
+}
+
+static void
+report(const char *name, const char *op, int n, double elapsed)
+{
+	printf("%-6s %-10s %8.2f Mops/s\n", name, op, n / elapsed / 1e6);
+}
+
+static void
+run_heap(void)
+{
+	min_heap_t s;
+	double start;
+	int i, j;
+
+	srandom(1);
+	min_heap_ctor(&s);
+	for (i = 0; i < nevent; i++) {
+		min_heap_elem_init(&ev[i]);
+		set_random_timeout(&ev[i]);
+	}
+
+	start = now_sec();
+	for (i = 0; i < nevent; i++)
+		min_heap_push(&s, &ev[i]);
+	report("heap", "push", nevent, now_sec() - start);
+
+	start = now_sec();
+	for (i = 0; i < nevent; i++) {
+		j = random() % nevent;
+		min_heap_erase(&s, &ev[j]);
+		set_random_timeout(&ev[j]);
+		min_heap_push(&s, &ev[j]);
+	}
+	report("heap", "erase+push", nevent, now_sec() - start);
+
+	start = now_sec();
+	while (min_heap_pop(&s))
+		;
+	report("heap", "pop", nevent, now_sec() - start);
+	min_heap_dtor(&s);
+}
+
+static void
+run_heap4(void)
+{
+	min_heap4_t s;
+	double start;
+	int i, j;
+
+	srandom(1);
+	min_heap4_ctor(&s);
+	for (i = 0; i < nevent; i++) {
+		min_heap_elem_init(&ev[i]);
+		set_random_timeout(&ev[i]);
+	}
+
+	start = now_sec();
+	for (i = 0; i < nevent; i++)
+		min_heap4_push(&s, &ev[i]);
+	report("heap4", "push", nevent, now_sec() - start);
+
+	start = now_sec();
+	for (i = 0; i < nevent; i++) {
+		j = random() % nevent;
+		min_heap4_erase(&s, &ev[j]);
+		set_random_timeout(&ev[j]);
+		min_heap4_push(&s, &ev[j]);
+	}
+	report("heap4", "erase+push", nevent, now_sec() - start);
+
+	start = now_sec();
+	while (min_heap4_pop(&s))
+		;
+	report("heap4", "pop", nevent, now_sec() - start);
+	min_heap4_dtor(&s);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 1)
+		nevent = atoi(argv[1]);
+	if ((ev = calloc(nevent, sizeof(struct event))) == NULL)
+		return (1);
+
+	run_heap();
+	run_heap4();
+	return (0);
+}
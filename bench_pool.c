@@ -0,0 +1,141 @@
+/*
+ * Connection churn with caller-malloc'd events against event_new()'s
+ * per-base slabs.  Each "connection" gets a read event with an idle
+ * timeout on one of nslots socketpairs; the oldest one is torn down for
+ * every new one, so the live set stays at nslots:
+ *
+ *	bench_pool.out [nconns [nslots]]
+ *
+ * Run with EVENT_EPOLL_USE_CHANGELIST set to cancel the epoll_ctl pair
+ * each reconnect costs and leave allocation as the main difference.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "event.h"
+
+
+
+static int nconns = 1000000, nslots = 256;
+static int *fds;
+static struct event **live;
+
+
+static void
+read_cb(int fd, short what, void *arg)
+{
+}
+
+static double
+now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+static double
+run(struct event_base *base, int pooled)
+{
+	struct timeval idle = { 30, 0 };
+	struct event *ev;
+	double t0, t1;
+	int i, slot;
+
+	memset(live, 0, nslots * sizeof(struct event *));
+	if (pooled)
+		event_base_prealloc_events(base, nslots);
+
+	t0 = now_usec();
+	for (i = 0; i < nconns; i++) {
+		slot = i % nslots;
+		if ((ev = live[slot]) != NULL) {
+			if (pooled) {
+				event_free(ev);
+			} else {
+				event_del(ev);
+				free(ev);
+			}
+		}
+
+		if (pooled) {
+			ev = event_new(base, fds[slot], EV_READ | EV_PERSIST,
+			    read_cb, NULL);
+		} else {
+			ev = malloc(sizeof(struct event));
+			event_set(ev, fds[slot], EV_READ | EV_PERSIST,
+			    read_cb, NULL);
+			event_base_set(base, ev);
+		}
+		event_add(ev, &idle);
+		live[slot] = ev;
+
+		/* let the loop see the churn now and then, as a server would */
+		if (slot == nslots - 1)
+			event_base_loop(base, EVLOOP_NONBLOCK);
+	}
+	t1 = now_usec();
+
+	for (slot = 0; slot < nslots; slot++) {
+		if ((ev = live[slot]) == NULL)
+			continue;
+		if (pooled) {
+			event_free(ev);
+		} else {
+			event_del(ev);
+			free(ev);
+		}
+	}
+	return (t1 - t0);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct event_base *base;
+	double usec;
+	int i, pair[2];
+
+	if (argc > 1)
+		nconns = atoi(argv[1]);
+	if (argc > 2)
+		nslots = atoi(argv[2]);
+	if (nconns < 1 || nslots < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return (1);
+	}
+
+	fds = calloc(nslots, sizeof(int));
+	live = calloc(nslots, sizeof(struct event *));
+	if (fds == NULL || live == NULL) {
+		perror("calloc");
+		return (1);
+	}
+	for (i = 0; i < nslots; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+			perror("socketpair");
+			return (1);
+		}
+		fds[i] = pair[0];
+	}
+
+	printf("%d connections, %d live\n", nconns, nslots);
+
+	base = event_base_new();
+	usec = run(base, 0);
+	printf("malloc     %8.0f ms %10.0f conns/s\n", usec / 1e3,
+	    nconns / (usec / 1e6));
+	event_base_free(base);
+
+	base = event_base_new();
+	usec = run(base, 1);
+	printf("event_new  %8.0f ms %10.0f conns/s\n", usec / 1e3,
+	    nconns / (usec / 1e6));
+	event_base_free(base);
+	return (0);
+}
@@ -0,0 +1,74 @@
+/*
+ * Per-iteration loop cost as the number of priorities grows.  Two events
+ * at neighbouring priorities activate each other from their callbacks.
+ * Only the queue being drained is run per pass, so every activation
+ * costs a pass through event_base_loop() and a search for its queue:
+ *
+ *	bench_prio.out [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "event.h"
+
+
+
+static int iterations = 1000000;
+static int left;
+
+
+static void
+spin_cb(int fd, short what, void *arg)
+{
+	struct event *other = arg;
+
+	if (--left > 0)
+		event_active(other, EV_TIMEOUT, 1);
+}
+
+static void
+run(int npriorities, int pri)
+{
+	struct event_base *base;
+	struct event ev[2];
+	struct timespec t0, t1;
+	double nsec;
+	int i;
+
+	base = event_base_new();
+	event_base_priority_init(base, npriorities);
+	for (i = 0; i < 2; i++) {
+		evtimer_set(&ev[i], spin_cb, &ev[!i]);
+		event_base_set(base, &ev[i]);
+		event_priority_set(&ev[i], pri + i);
+	}
+
+	left = iterations;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	event_active(&ev[0], EV_TIMEOUT, 1);
+	event_base_loop(base, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	nsec = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	printf("%4d priorities, events at %3d: %7.1f ns/iteration\n",
+	    npriorities, pri, nsec / iterations);
+	event_base_free(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (iterations < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return (1);
+	}
+
+	run(2, 0);
+	run(256, 0);
+	run(256, 127);
+	run(256, 254);
+	return (0);
+}
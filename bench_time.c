@@ -0,0 +1,102 @@
+/*
+ * test_time.c's add/del churn scaled up, run once on each timer store:
+ *
+ *	bench_time.out [ntimers [callbacks]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "event.h"
+
+
+
+static int nevent = 1000000;
+static int ncallbacks;
+static int called;
+
+static struct event *ev;
+
+
+static int
+rand_int(int n)
+{
+	return (int)(random() % n);
+}
+
+static void
+time_cb(int fd, short event, void *arg)
+{
+	struct timeval tv;
+	int i, j;
+	called++;
+	if (called < ncallbacks) {
+		for (i = 0; i < 10; i++) {
+			j = rand_int(nevent);
+			tv.tv_sec = 0;
+			tv.tv_usec = rand_int(50000);
+			if (tv.tv_usec % 2)
+				evtimer_add(&ev[j], &tv);
+			else
+				evtimer_del(&ev[j]);
+		}
+	}
+}
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+run(int method, const char *name)
+{
+	struct event_base *base;
+	struct timeval tv;
+	double start, elapsed;
+	int i;
+
+	srandom(1);
+	called = 0;
+	base = event_init();
+	if (event_base_set_timeout_method(base, method) == -1) {
+		fprintf(stderr, "%s: unsupported\n", name);
+		exit(1);
+	}
+
+	start = now_sec();
+	for (i = 0; i < nevent; i++) {
+		evtimer_set(&ev[i], time_cb, &ev[i]);
+		tv.tv_sec = 0;
+		tv.tv_usec = rand_int(50000);
+		evtimer_add(&ev[i], &tv);
+	}
+	event_dispatch();
+	elapsed = now_sec() - start;
+
+	printf("%-6s %d timers, %d callbacks: %.3f s, %.0f ns/callback\n",
+	    name, nevent, called, elapsed, elapsed * 1e9 / called);
+	return elapsed;
+}
+
+int
+main(int argc, char **argv)
+{
+	double heap, heap4, wheel;
+
+	if (argc > 1)
+		nevent = atoi(argv[1]);
+	ncallbacks = argc > 2 ? atoi(argv[2]) : 2 * nevent;
+	if ((ev = calloc(nevent, sizeof(struct event))) == NULL)
+		return (1);
+
+	heap = run(EVENT_TIMEOUT_HEAP, "heap");
+	heap4 = run(EVENT_TIMEOUT_HEAP4, "heap4");
+	wheel = run(EVENT_TIMEOUT_WHEEL, "wheel");
+	printf("heap4/heap: %.2f wheel/heap: %.2f\n", heap4 / heap, wheel / heap);
+	return (0);
+}
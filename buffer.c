@@ -1,78 +1,383 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 
 #include "buffer.h"
 
+/* data bytes in a chunk, unless a single add needs a bigger one */
+#define EVBUFFER_CHAIN_SIZE	4096
+/* most one evbuffer_read() takes, however much the fd says it has */
+#define EVBUFFER_MAX_READ	(4 << 20)
+/* chunks one evbuffer_write() hands to writev() */
+#define EVBUFFER_MAX_IOV	64
 
+struct evbuffer_chain {
+	struct evbuffer_chain *next;
+	size_t buffer_len;	/* size of buffer[] */
+	size_t misalign;	/* bytes already drained from the front */
+	size_t off;		/* bytes of data after misalign */
+	u_char buffer[];
+};
+
+#define CHAIN_SPACE(ch)	((ch)->buffer_len - (ch)->misalign - (ch)->off)
+#define CHAIN_DATA(ch)	((ch)->buffer + (ch)->misalign)
+
+/*
+ * Data lives in first .. last.  Only the last chunk has room to append
+ * to.  An empty buffer keeps its last chunk, if it is a small one, so a
+ * request/response pattern does not allocate on every message.
+ */
+struct evbuffer {
+	struct evbuffer_chain *first;
+	struct evbuffer_chain *last;
+	size_t total_len;
+
+	void (*cb)(struct evbuffer *, size_t, size_t, void *);
+	void *cbarg;
+};
+
+
+static struct evbuffer_chain *
+evbuffer_chain_new(size_t size)
+{
+	struct evbuffer_chain *chain;
+
+	if (size < EVBUFFER_CHAIN_SIZE)
+		size = EVBUFFER_CHAIN_SIZE;
+	if ((chain = malloc(sizeof(struct evbuffer_chain) + size)) == NULL)
+		return (NULL);
+	chain->next = NULL;
+	chain->buffer_len = size;
+	chain->misalign = 0;
+	chain->off = 0;
+	return (chain);
+}
 
 static void
-evbuffer_align(struct evbuffer *buf)
+evbuffer_chain_insert(struct evbuffer *buf, struct evbuffer_chain *chain)
+{
+	if (buf->last == NULL) {
+		buf->first = buf->last = chain;
+	} else if (buf->total_len == 0) {
+		/* only the kept empty chunk is there; replace it */
+		free(buf->first);
+		buf->first = buf->last = chain;
+	} else {
+		buf->last->next = chain;
+		buf->last = chain;
+	}
+}
+
+/* Frees every chunk, keeping the last one if it is empty and small. */
+static void
+evbuffer_free_chains(struct evbuffer *buf, int keep)
+{
+	struct evbuffer_chain *chain, *next;
+
+	for (chain = buf->first; chain != NULL; chain = next) {
+		next = chain->next;
+		if (next == NULL && keep &&
+		    chain->buffer_len == EVBUFFER_CHAIN_SIZE) {
+			chain->misalign = chain->off = 0;
+			buf->first = buf->last = chain;
+			return;
+		}
+		free(chain);
+	}
+	buf->first = buf->last = NULL;
+}
+
+static void
+evbuffer_invoke_cb(struct evbuffer *buf, size_t oldlen)
+{
+	/* Tell someone about changes in this buffer */
+	if (buf->total_len != oldlen && buf->cb != NULL)
+		(*buf->cb)(buf, oldlen, buf->total_len, buf->cbarg);
+}
+
+struct evbuffer *
+evbuffer_new(void)
+{
+	return (calloc(1, sizeof(struct evbuffer)));
+}
+
+void
+evbuffer_free(struct evbuffer *buf)
 {
-	memmove(buf->orig_buffer, buf->buffer, buf->off);
-	buf->buffer = buf->orig_buffer;
-	buf->misalign = 0;
+	evbuffer_free_chains(buf, 0);
+	free(buf);
 }
 
+size_t
+evbuffer_get_length(const struct evbuffer *buf)
+{
+	return (buf->total_len);
+}
+
+size_t
+evbuffer_get_contiguous_space(const struct evbuffer *buf)
+{
+	return (buf->first != NULL ? buf->first->off : 0);
+}
 
 int
 evbuffer_expand(struct evbuffer *buf, size_t datlen)
 {
-	size_t need = buf->misalign + buf->off + datlen;
+	struct evbuffer_chain *chain;
 
 	/* If we can fit all the data, then we don't have to do anything */
-	if (buf->totallen >= need)
+	if (buf->last != NULL && CHAIN_SPACE(buf->last) >= datlen)
 		return (0);
 
-	/*
-	 *	 * If the misalignment fulfills our data needs, we just force an
-	 *		 * alignment to happen.  Afterwards, we have enough space.
-	 *			 */
-	if (buf->misalign >= datlen) {
-		evbuffer_align(buf);
-	} else {
-		void *newbuf;
-		size_t length = buf->totallen;
+	if ((chain = evbuffer_chain_new(datlen)) == NULL)
+		return (-1);
+	evbuffer_chain_insert(buf, chain);
+	return (0);
+}
 
-		if (length < 256)
-			length = 256;
-		while (length < need)
-			length <<= 1;
+int
+evbuffer_add(struct evbuffer *buf, const void *data, size_t datlen)
+{
+	struct evbuffer_chain *last = buf->last, *chain = NULL;
+	size_t oldlen = buf->total_len, n = 0;
 
-		if (buf->orig_buffer != buf->buffer)
-			evbuffer_align(buf);
-		if ((newbuf = realloc(buf->buffer, length)) == NULL)
-			return (-1);
+	if (last != NULL) {
+		n = CHAIN_SPACE(last);
+		if (n > datlen)
+			n = datlen;
+	}
+	/* allocate before copying so a failure leaves the buffer alone */
+	if (datlen > n && (chain = evbuffer_chain_new(datlen - n)) == NULL)
+		return (-1);
 
-		buf->orig_buffer = buf->buffer = newbuf;
-		buf->totallen = length;
+	if (n) {
+		memcpy(CHAIN_DATA(last) + last->off, data, n);
+		last->off += n;
+		buf->total_len += n;
+	}
+	if (chain != NULL) {
+		memcpy(chain->buffer, (const u_char *)data + n, datlen - n);
+		chain->off = datlen - n;
+		evbuffer_chain_insert(buf, chain);
+		buf->total_len += chain->off;
 	}
 
+	evbuffer_invoke_cb(buf, oldlen);
 	return (0);
 }
 
+int
+evbuffer_add_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
+{
+	size_t out_oldlen = outbuf->total_len, in_oldlen = inbuf->total_len;
+
+	if (in_oldlen == 0)
+		return (0);
+
+	/* hand the chunks over instead of copying them */
+	if (out_oldlen == 0) {
+		evbuffer_free_chains(outbuf, 0);
+		outbuf->first = inbuf->first;
+	} else {
+		outbuf->last->next = inbuf->first;
+	}
+	outbuf->last = inbuf->last;
+	outbuf->total_len += in_oldlen;
+	inbuf->first = inbuf->last = NULL;
+	inbuf->total_len = 0;
+
+	evbuffer_invoke_cb(inbuf, in_oldlen);
+	evbuffer_invoke_cb(outbuf, out_oldlen);
+	return (0);
+}
+
+int
+evbuffer_remove(struct evbuffer *buf, void *data, size_t datlen)
+{
+	struct evbuffer_chain *chain;
+	u_char *dst = data;
+	size_t nread, left, n;
+
+	nread = left = datlen < buf->total_len ? datlen : buf->total_len;
+	for (chain = buf->first; left > 0; chain = chain->next) {
+		n = chain->off < left ? chain->off : left;
+		memcpy(dst, CHAIN_DATA(chain), n);
+		dst += n;
+		left -= n;
+	}
+	evbuffer_drain(buf, nread);
+
+	return (nread);
+}
+
 void
 evbuffer_drain(struct evbuffer *buf, size_t len)
 {
-	size_t oldoff = buf->off;
+	struct evbuffer_chain *chain, *next;
+	size_t oldlen = buf->total_len;
 
-	if (len >= buf->off) {
-		buf->off = 0;
-		buf->buffer = buf->orig_buffer;
-		buf->misalign = 0;
+	if (len >= buf->total_len) {
+		evbuffer_free_chains(buf, 1);
+		buf->total_len = 0;
 		goto done;
 	}
 
-	buf->buffer += len;
-	buf->misalign += len;
-
-	buf->off -= len;
+	buf->total_len -= len;
+	for (chain = buf->first; len >= chain->off; chain = next) {
+		/* whole chunks go without touching their data */
+		next = chain->next;
+		len -= chain->off;
+		free(chain);
+	}
+	buf->first = chain;
+	chain->misalign += len;
+	chain->off -= len;
 
 done:
-	/* Tell someone about changes in this buffer */
-	if (buf->off != oldoff && buf->cb != NULL)
-		(*buf->cb)(buf, oldoff, buf->off, buf->cbarg);
+	evbuffer_invoke_cb(buf, oldlen);
+}
 
+u_char *
+evbuffer_pullup(struct evbuffer *buf, ssize_t size)
+{
+	struct evbuffer_chain *chain = buf->first, *tmp, *next;
+	u_char *dst;
+	size_t left;
+
+	if (size < 0)
+		size = buf->total_len;
+	if (size == 0 || (size_t)size > buf->total_len)
+		return (NULL);
+	if (chain->off >= (size_t)size)
+		return (CHAIN_DATA(chain));
+
+	/* gather into the first chunk if it has the room, else a new one */
+	if (chain->buffer_len - chain->misalign >= (size_t)size) {
+		tmp = chain;
+		chain = chain->next;
+	} else {
+		if ((tmp = evbuffer_chain_new(size)) == NULL)
+			return (NULL);
+	}
+	dst = CHAIN_DATA(tmp) + tmp->off;
+	left = size - tmp->off;
+
+	while (left > 0 && chain->off <= left) {
+		memcpy(dst, CHAIN_DATA(chain), chain->off);
+		dst += chain->off;
+		left -= chain->off;
+		next = chain->next;
+		free(chain);
+		chain = next;
+	}
+	if (left > 0) {
+		memcpy(dst, CHAIN_DATA(chain), left);
+		chain->misalign += left;
+		chain->off -= left;
+	}
+	tmp->off = size;
+	tmp->next = chain;
+	buf->first = tmp;
+	if (chain == NULL)
+		buf->last = tmp;
+
+	return (CHAIN_DATA(tmp));
 }
 
+/*
+ * Reads what the fd has queued, or at most howmuch if that is not -1,
+ * with one readv() into the last chunk's free space and a new chunk
+ * sized for the rest.  Returns what read() would.
+ */
+int
+evbuffer_read(struct evbuffer *buf, int fd, int howmuch)
+{
+	struct evbuffer_chain *last = buf->last, *chain = NULL;
+	struct iovec iov[2];
+	size_t oldlen = buf->total_len, space = 0;
+	ssize_t n;
+	int navail, niov = 0;
 
+	/* nothing to read into; readv() would return 0 and look like EOF */
+	if (howmuch == 0)
+		return (0);
+	if (ioctl(fd, FIONREAD, &navail) == -1 || navail <= 0)
+		navail = EVBUFFER_CHAIN_SIZE;	/* unknown, or EOF */
+	else if (navail > EVBUFFER_MAX_READ)
+		navail = EVBUFFER_MAX_READ;
+	if (howmuch < 0 || howmuch > navail)
+		howmuch = navail;
+
+	if (last != NULL && (space = CHAIN_SPACE(last)) > 0) {
+		if (space > (size_t)howmuch)
+			space = howmuch;
+		iov[niov].iov_base = CHAIN_DATA(last) + last->off;
+		iov[niov++].iov_len = space;
+	}
+	if ((size_t)howmuch > space) {
+		if ((chain = evbuffer_chain_new(howmuch - space)) == NULL)
+			return (-1);
+		iov[niov].iov_base = chain->buffer;
+		iov[niov++].iov_len = howmuch - space;
+	}
+
+	n = readv(fd, iov, niov);
+	if (n <= 0) {
+		free(chain);
+		return (n);
+	}
+
+	if (space) {
+		if (space > (size_t)n)
+			space = n;
+		last->off += space;
+		buf->total_len += space;
+	}
+	if ((size_t)n > space) {
+		chain->off = n - space;
+		evbuffer_chain_insert(buf, chain);
+		buf->total_len += chain->off;
+	} else {
+		free(chain);
+	}
+
+	evbuffer_invoke_cb(buf, oldlen);
+	return (n);
+}
+
+/* Writes as much as the fd takes with one writev() across the chunks,
+ * then drains it.  Returns what write() would. */
+int
+evbuffer_write(struct evbuffer *buf, int fd)
+{
+	struct evbuffer_chain *chain;
+	struct iovec iov[EVBUFFER_MAX_IOV];
+	ssize_t n;
+	int i = 0;
+
+	for (chain = buf->first; chain != NULL && i < EVBUFFER_MAX_IOV;
+	    chain = chain->next) {
+		if (chain->off == 0)
+			continue;
+		iov[i].iov_base = CHAIN_DATA(chain);
+		iov[i++].iov_len = chain->off;
+	}
+	if (i == 0)
+		return (0);
+
+	n = writev(fd, iov, i);
+	if (n > 0)
+		evbuffer_drain(buf, n);
+	return (n);
+}
+
+void
+evbuffer_setcb(struct evbuffer *buffer,
+    void (*cb)(struct evbuffer *, size_t, size_t, void *), void *cbarg)
+{
+	buffer->cb = cb;
+	buffer->cbarg = cbarg;
+}
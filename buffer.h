@@ -1,18 +1,49 @@
-struct evbuffer {
-	u_char *buffer;
-	u_char *orig_buffer;
+#ifndef _BUFFER_H_
+#define _BUFFER_H_
 
-	size_t misalign;
-	size_t totallen;
-	size_t off;
+#include <sys/types.h>
 
-	void (*cb)(struct evbuffer *, size_t, size_t, void *);
-	void *cbarg;
-};
+/*
+ * A byte queue kept as a chain of chunks.  Appending fills the last
+ * chunk and then links a new one, and draining frees whole chunks from
+ * the front, so data already in the buffer is never moved.  Parsers
+ * that need a contiguous view ask for one with evbuffer_pullup().
+ */
+struct evbuffer;
 
-static void evbuffer_align(struct evbuffer *buf);
+#define EVBUFFER_LENGTH(x)	evbuffer_get_length(x)
+#define EVBUFFER_DATA(x)	evbuffer_pullup((x), -1)
 
-int evbuffer_expand(struct evbuffer *buf, size_t datlen);
+struct evbuffer *evbuffer_new(void);
+void evbuffer_free(struct evbuffer *);
+
+size_t evbuffer_get_length(const struct evbuffer *);
+/* Bytes that can be read at the front without a pullup. */
+size_t evbuffer_get_contiguous_space(const struct evbuffer *);
 
+/* Makes room for datlen more bytes in one chunk at the end. */
+int evbuffer_expand(struct evbuffer *buf, size_t datlen);
+int evbuffer_add(struct evbuffer *, const void *, size_t);
+/* Moves all of the second buffer's data to the end of the first. */
+int evbuffer_add_buffer(struct evbuffer *, struct evbuffer *);
+/* Copies out and drains up to datlen bytes; returns how many. */
+int evbuffer_remove(struct evbuffer *, void *, size_t datlen);
 
 void evbuffer_drain(struct evbuffer *buf, size_t len);
+
+/* Scatter/gather I/O straight into and out of the chunks.  A howmuch
+ * of -1 reads whatever FIONREAD says the fd has queued; a howmuch of 0
+ * returns 0 without touching the fd, so 0 only means EOF otherwise. */
+int evbuffer_read(struct evbuffer *, int fd, int howmuch);
+int evbuffer_write(struct evbuffer *, int fd);
+
+/* Makes the first size bytes contiguous, or all of them if size is -1,
+ * and returns them; NULL if the buffer holds fewer than size bytes. */
+u_char *evbuffer_pullup(struct evbuffer *, ssize_t size);
+
+/* cb runs whenever the amount of data changes, with the old and new
+ * lengths. */
+void evbuffer_setcb(struct evbuffer *,
+    void (*)(struct evbuffer *, size_t, size_t, void *), void *);
+
+#endif /* _BUFFER_H_ */
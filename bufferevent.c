@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "event.h"
+#include "evutil.h"
+#include "buffer.h"
+#include "bufferevent.h"
+
+struct event_watermark {
+	size_t low;
+	size_t high;
+};
+
+struct bufferevent {
+	struct event_base *base;
+	struct event ev_read;
+	struct event ev_write;
+
+	struct evbuffer *input;
+	struct evbuffer *output;
+
+	struct event_watermark wm_read;
+	struct event_watermark wm_write;
+
+	evbuffercb readcb;
+	evbuffercb writecb;
+	everrorcb errorcb;
+	void *cbarg;
+
+	struct timeval timeout_read;
+	struct timeval timeout_write;
+
+	short enabled;
+	int read_suspended;	/* input is at its high watermark */
+	int writing;		/* ev_write is registered */
+	int fd;
+};
+
+
+static int
+bufferevent_add_read(struct bufferevent *bev)
+{
+	return (event_add(&bev->ev_read,
+	    evutil_timerisset(&bev->timeout_read) ? &bev->timeout_read : NULL));
+}
+
+static int
+bufferevent_add_write(struct bufferevent *bev)
+{
+	bev->writing = 1;
+	return (event_add(&bev->ev_write,
+	    evutil_timerisset(&bev->timeout_write) ? &bev->timeout_write : NULL));
+}
+
+static void
+bufferevent_stop_write(struct bufferevent *bev)
+{
+	bev->writing = 0;
+	event_del(&bev->ev_write);
+}
+
+/* Stop reading while the input is at its high watermark, resume once it
+ * has been drained below it. */
+static void
+bufferevent_read_pressure(struct bufferevent *bev)
+{
+	size_t len = EVBUFFER_LENGTH(bev->input);
+
+	if (bev->wm_read.high != 0 && len >= bev->wm_read.high) {
+		if (!bev->read_suspended) {
+			bev->read_suspended = 1;
+			event_del(&bev->ev_read);
+		}
+	} else if (bev->read_suspended) {
+		bev->read_suspended = 0;
+		if (bev->enabled & EV_READ)
+			bufferevent_add_read(bev);
+	}
+}
+
+static void
+bufferevent_input_cb(struct evbuffer *buf, size_t old, size_t now, void *arg)
+{
+	bufferevent_read_pressure(arg);
+}
+
+/* Data was queued: make sure the write event is registered. */
+static void
+bufferevent_output_cb(struct evbuffer *buf, size_t old, size_t now,
+    void *arg)
+{
+	struct bufferevent *bev = arg;
+
+	if (now > old && !bev->writing && (bev->enabled & EV_WRITE))
+		bufferevent_add_write(bev);
+}
+
+static void
+bufferevent_readcb(int fd, short event, void *arg)
+{
+	struct bufferevent *bev = arg;
+	short what = EVBUFFER_READ;
+	int howmuch = -1, n;
+	size_t len;
+
+	if (event == EV_TIMEOUT) {
+		what |= EVBUFFER_TIMEOUT;
+		goto error;
+	}
+
+	/* read no further than the high watermark */
+	len = EVBUFFER_LENGTH(bev->input);
+	if (bev->wm_read.high != 0) {
+		if (len >= bev->wm_read.high) {
+			bufferevent_read_pressure(bev);
+			return;
+		}
+		howmuch = bev->wm_read.high - len > INT_MAX ? INT_MAX :
+		    (int)(bev->wm_read.high - len);
+	}
+
+	/* may suspend reading at the high watermark */
+	n = evbuffer_read(bev->input, fd, howmuch);
+	if (n == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return;
+		what |= EVBUFFER_ERROR;
+		goto error;
+	} else if (n == 0) {
+		what |= EVBUFFER_EOF;
+		goto error;
+	}
+	/* restart the idle timer */
+	if (!bev->read_suspended && evutil_timerisset(&bev->timeout_read))
+		bufferevent_add_read(bev);
+
+	if (EVBUFFER_LENGTH(bev->input) < bev->wm_read.low)
+		return;
+	if (bev->readcb != NULL)
+		(*bev->readcb)(bev, bev->cbarg);
+	return;
+
+error:
+	bufferevent_disable(bev, EV_READ);
+	if (bev->errorcb != NULL)
+		(*bev->errorcb)(bev, what, bev->cbarg);
+}
+
+static void
+bufferevent_writecb(int fd, short event, void *arg)
+{
+	struct bufferevent *bev = arg;
+	short what = EVBUFFER_WRITE;
+	int n;
+
+	if (event == EV_TIMEOUT) {
+		what |= EVBUFFER_TIMEOUT;
+		goto error;
+	}
+
+	if (EVBUFFER_LENGTH(bev->output)) {
+		n = evbuffer_write(bev->output, fd);
+		if (n == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			    errno == EINTR)
+				return;
+			what |= EVBUFFER_ERROR;
+			goto error;
+		} else if (n == 0) {
+			what |= EVBUFFER_EOF;
+			goto error;
+		}
+	}
+
+	/* nothing left to write: stop watching for writability */
+	if (EVBUFFER_LENGTH(bev->output) == 0)
+		bufferevent_stop_write(bev);
+	else if (evutil_timerisset(&bev->timeout_write))
+		bufferevent_add_write(bev);
+
+	if (EVBUFFER_LENGTH(bev->output) <= bev->wm_write.low &&
+	    bev->writecb != NULL)
+		(*bev->writecb)(bev, bev->cbarg);
+	return;
+
+error:
+	bufferevent_disable(bev, EV_WRITE);
+	if (bev->errorcb != NULL)
+		(*bev->errorcb)(bev, what, bev->cbarg);
+}
+
+struct bufferevent *
+bufferevent_new(struct event_base *base, int fd, evbuffercb readcb,
+    evbuffercb writecb, everrorcb errorcb, void *cbarg)
+{
+	struct bufferevent *bev;
+
+	if ((bev = calloc(1, sizeof(struct bufferevent))) == NULL)
+		return (NULL);
+	if ((bev->input = evbuffer_new()) == NULL) {
+		free(bev);
+		return (NULL);
+	}
+	if ((bev->output = evbuffer_new()) == NULL) {
+		evbuffer_free(bev->input);
+		free(bev);
+		return (NULL);
+	}
+	evbuffer_setcb(bev->input, bufferevent_input_cb, bev);
+	evbuffer_setcb(bev->output, bufferevent_output_cb, bev);
+
+	bev->base = base;
+	bev->fd = fd;
+	event_set(&bev->ev_read, fd, EV_READ | EV_PERSIST, bufferevent_readcb,
+	    bev);
+	event_base_set(base, &bev->ev_read);
+	event_set(&bev->ev_write, fd, EV_WRITE | EV_PERSIST,
+	    bufferevent_writecb, bev);
+	event_base_set(base, &bev->ev_write);
+
+	bufferevent_setcb(bev, readcb, writecb, errorcb, cbarg);
+	bev->enabled = EV_WRITE;
+	return (bev);
+}
+
+void
+bufferevent_free(struct bufferevent *bev)
+{
+	event_del(&bev->ev_read);
+	event_del(&bev->ev_write);
+	evbuffer_free(bev->input);
+	evbuffer_free(bev->output);
+	free(bev);
+}
+
+void
+bufferevent_setcb(struct bufferevent *bev, evbuffercb readcb,
+    evbuffercb writecb, everrorcb errorcb, void *cbarg)
+{
+	bev->readcb = readcb;
+	bev->writecb = writecb;
+	bev->errorcb = errorcb;
+	bev->cbarg = cbarg;
+}
+
+int
+bufferevent_write(struct bufferevent *bev, const void *data, size_t size)
+{
+	return (evbuffer_add(bev->output, data, size));
+}
+
+int
+bufferevent_write_buffer(struct bufferevent *bev, struct evbuffer *buf)
+{
+	return (evbuffer_add_buffer(bev->output, buf));
+}
+
+size_t
+bufferevent_read(struct bufferevent *bev, void *data, size_t size)
+{
+	return (evbuffer_remove(bev->input, data, size));
+}
+
+int
+bufferevent_enable(struct bufferevent *bev, short event)
+{
+	if (event & EV_READ) {
+		bev->enabled |= EV_READ;
+		if (!bev->read_suspended && bufferevent_add_read(bev) == -1)
+			return (-1);
+	}
+	if (event & EV_WRITE) {
+		bev->enabled |= EV_WRITE;
+		if (EVBUFFER_LENGTH(bev->output) &&
+		    bufferevent_add_write(bev) == -1)
+			return (-1);
+	}
+	return (0);
+}
+
+int
+bufferevent_disable(struct bufferevent *bev, short event)
+{
+	if (event & EV_READ) {
+		bev->enabled &= ~EV_READ;
+		if (event_del(&bev->ev_read) == -1)
+			return (-1);
+	}
+	if (event & EV_WRITE) {
+		bev->enabled &= ~EV_WRITE;
+		bufferevent_stop_write(bev);
+	}
+	return (0);
+}
+
+void
+bufferevent_set_timeouts(struct bufferevent *bev,
+    const struct timeval *timeout_read, const struct timeval *timeout_write)
+{
+	if (timeout_read != NULL)
+		bev->timeout_read = *timeout_read;
+	else
+		evutil_timerclear(&bev->timeout_read);
+	if (timeout_write != NULL)
+		bev->timeout_write = *timeout_write;
+	else
+		evutil_timerclear(&bev->timeout_write);
+
+	/* event_add() keeps an old timeout when given none, so registered
+	 * events are deleted and added again */
+	if ((bev->enabled & EV_READ) && !bev->read_suspended) {
+		event_del(&bev->ev_read);
+		bufferevent_add_read(bev);
+	}
+	if (bev->writing) {
+		event_del(&bev->ev_write);
+		bufferevent_add_write(bev);
+	}
+}
+
+void
+bufferevent_setwatermark(struct bufferevent *bev, short events,
+    size_t lowmark, size_t highmark)
+{
+	if (events & EV_READ) {
+		bev->wm_read.low = lowmark;
+		bev->wm_read.high = highmark;
+		bufferevent_read_pressure(bev);
+	}
+	if (events & EV_WRITE) {
+		bev->wm_write.low = lowmark;
+		bev->wm_write.high = highmark;
+	}
+}
+
+struct evbuffer *
+bufferevent_get_input(struct bufferevent *bev)
+{
+	return (bev->input);
+}
+
+struct evbuffer *
+bufferevent_get_output(struct bufferevent *bev)
+{
+	return (bev->output);
+}
+
+int
+bufferevent_get_fd(struct bufferevent *bev)
+{
+	return (bev->fd);
+}
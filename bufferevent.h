@@ -0,0 +1,57 @@
+#ifndef _BUFFEREVENT_H_
+#define _BUFFEREVENT_H_
+
+#include <sys/types.h>
+
+struct event_base;
+struct evbuffer;
+struct timeval;
+
+/*
+ * A connection with an input and an output evbuffer.  Data is read into
+ * the input buffer while reading is enabled and the buffer is under its
+ * high watermark; the read callback runs once it holds at least the low
+ * watermark.  The write event is only registered while the output
+ * buffer has data, and the write callback runs once it has drained to
+ * its low watermark.  Both buffers' evbuffer callbacks belong to the
+ * bufferevent.  The fd is not closed when the bufferevent is freed.
+ */
+struct bufferevent;
+
+typedef void (*evbuffercb)(struct bufferevent *, void *);
+/* what is EVBUFFER_READ or EVBUFFER_WRITE plus the reason */
+typedef void (*everrorcb)(struct bufferevent *, short what, void *);
+
+#define EVBUFFER_READ		0x01
+#define EVBUFFER_WRITE		0x02
+#define EVBUFFER_EOF		0x10
+#define EVBUFFER_ERROR		0x20
+#define EVBUFFER_TIMEOUT	0x40
+
+/* Writing starts out enabled; reading waits for bufferevent_enable(). */
+struct bufferevent *bufferevent_new(struct event_base *, int fd,
+    evbuffercb readcb, evbuffercb writecb, everrorcb errorcb, void *cbarg);
+void bufferevent_free(struct bufferevent *);
+void bufferevent_setcb(struct bufferevent *,
+    evbuffercb, evbuffercb, everrorcb, void *);
+
+int bufferevent_write(struct bufferevent *, const void *, size_t);
+int bufferevent_write_buffer(struct bufferevent *, struct evbuffer *);
+size_t bufferevent_read(struct bufferevent *, void *, size_t);
+
+int bufferevent_enable(struct bufferevent *, short);
+int bufferevent_disable(struct bufferevent *, short);
+
+/* Idle timeouts for each direction; NULL for none.  On expiry the error
+ * callback gets EVBUFFER_TIMEOUT and that direction is disabled. */
+void bufferevent_set_timeouts(struct bufferevent *,
+    const struct timeval *, const struct timeval *);
+/* A high watermark of 0 means unlimited; writes only use the low one. */
+void bufferevent_setwatermark(struct bufferevent *, short,
+    size_t lowmark, size_t highmark);
+
+struct evbuffer *bufferevent_get_input(struct bufferevent *);
+struct evbuffer *bufferevent_get_output(struct bufferevent *);
+int bufferevent_get_fd(struct bufferevent *);
+
+#endif /* _BUFFEREVENT_H_ */
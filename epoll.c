@@ -1,6 +1,8 @@
 #include <time.h>
 #include <errno.h>
 #include <sys/epoll.h> 
+#include <sys/timerfd.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -14,24 +16,52 @@
 #include "evutil.h"
 #include "log.h"
 #include "evsignal.h"
+#include "evmap.h"
 
 #define MAX_EPOLL_TIMEOUT_MSEC (35*60*1000)
 
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define HAVE_EPOLL_PWAIT2
+#endif
+
+/* Linux 4.5 and later; older kernels get the whole herd woken */
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE 0
+#endif
+
+/* How timeouts that are not whole milliseconds get waited for */
+#define EPOLL_HIRES_NONE    0   /* round up to epoll_wait's milliseconds */
+#define EPOLL_HIRES_PWAIT2  1   /* epoll_pwait2 takes a timespec */
+#define EPOLL_HIRES_TIMERFD 2   /* a timerfd in the epoll set */
+
 
 /* due to limitations in the epoll interface, we need to keep track of
  *  * all file descriptors outself.
  *   */
 struct evepoll {
-    struct event *evread;
-    struct event *evwrite;
+    struct evmap_io io;     /* every event watching the fd */
+    int registered;     /* interest mask currently known to the kernel */
+    int changed;        /* fd is queued on the changelist */
+    int dropped;        /* lost every event while queued */
 };
 
 struct epollop {
+    struct event_base *base;
     struct evepoll *fds;
     int nfds;
     struct epoll_event *events;
     int nevents;
     int epfd;
+
+    /* fds whose interest changed since the last epoll_wait */
+    int use_changelist;
+    int *changes;
+    int nchanges;
+    int changes_size;
+
+    int hires;
+    int timerfd;
 };  
 
 
@@ -50,7 +80,10 @@ const struct eventop epollops = {
     epoll_del,
     epoll_dispatch,
     epoll_dealloc,
-    1 /* need reinit */
+    1, /* need reinit */
+    NULL, /* readiness only */
+    NULL,
+    NULL
 };
 
 
@@ -77,7 +110,7 @@ epoll_recalc(struct event_base *base, void *arg, int max)
 
     if (max >= epollop->nfds) {
         struct evepoll *fds;
-        int nfds;
+        int i, nfds;
 
         nfds = epollop->nfds;
         while (nfds <= max)
@@ -89,8 +122,12 @@ epoll_recalc(struct event_base *base, void *arg, int max)
             return (-1);
         }
         epollop->fds = fds;
+        for (i = 0; i < epollop->nfds; i++)
+            evmap_io_relocate(&fds[i].io);
         memset(fds + epollop->nfds, 0,
                 (nfds - epollop->nfds) * sizeof(struct evepoll));
+        for (; i < nfds; i++)
+            evmap_io_init(&fds[i].io);
         epollop->nfds = nfds;
     }
 
@@ -98,10 +135,42 @@ epoll_recalc(struct event_base *base, void *arg, int max)
 }
 
 
+/* Pick the most precise way this kernel offers to wait for a timeout. */
+static void
+epoll_hires_init(struct epollop *epollop)
+{
+    struct epoll_event epev = {0, {0}};
+
+#ifdef HAVE_EPOLL_PWAIT2
+    struct timespec ts = {0, 0};
+
+    /* EVENT_EPOLL_NOPWAIT2 forces the timerfd, mostly for testing it */
+    if (!evutil_getenv("EVENT_EPOLL_NOPWAIT2") &&
+            epoll_pwait2(epollop->epfd, epollop->events, 1, &ts, NULL) != -1) {
+        epollop->hires = EPOLL_HIRES_PWAIT2;
+        return;
+    }
+#endif
+
+    epollop->timerfd = timerfd_create(CLOCK_MONOTONIC,
+            TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epollop->timerfd == -1)
+        return;
+    epev.data.fd = epollop->timerfd;
+    epev.events = EPOLLIN;
+    if (epoll_ctl(epollop->epfd, EPOLL_CTL_ADD, epollop->timerfd,
+                &epev) == -1) {
+        close(epollop->timerfd);
+        epollop->timerfd = -1;
+        return;
+    }
+    epollop->hires = EPOLL_HIRES_TIMERFD;
+}
+
 static 
 void *epoll_init (struct event_base *base)
 {
-    int epfd;
+    int i, epfd;
     struct epollop *epollop;
 
     /* Disable epollueue when this environment variable is set */
@@ -118,6 +187,7 @@ void *epoll_init (struct event_base *base)
     if (!(epollop = calloc(1, sizeof(struct epollop))))
         return (NULL);
 
+    epollop->base = base;
     epollop->epfd = epfd;
 
     /* Initalize fields */
@@ -135,17 +205,151 @@ void *epoll_init (struct event_base *base)
         return (NULL);
     }
     epollop->nfds = INITIAL_NFILES;
+    for (i = 0; i < INITIAL_NFILES; i++)
+        evmap_io_init(&epollop->fds[i].io);
+
+    /* Defer epoll_ctl until dispatch when this environment variable is set.
+     * Not the default: a failed epoll_ctl then only shows up as a warning
+     * from the dispatch, not as an error from event_add(). */
+    if (evutil_getenv("EVENT_EPOLL_USE_CHANGELIST"))
+        epollop->use_changelist = 1;
+
+    epollop->timerfd = -1;
+    if (!evutil_getenv("EVENT_EPOLL_NOHIRES"))
+        epoll_hires_init(epollop);
     evsignal_init(base);
     return (epollop);
 }
 
+/* The interest mask the fd should have given the events attached to it. */
+static int
+epoll_wanted(struct evepoll *evep)
+{
+    int events = 0;
+
+    if (evep->io.nread)
+        events |= EPOLLIN;
+    if (evep->io.nwrite)
+        events |= EPOLLOUT;
+    if (events && EVMAP_IO_ET(&evep->io))
+        events |= EPOLLET;
+    /* exclusivity only changes which other epoll sets get woken, so one
+     * event asking for it is enough */
+    if (events && evep->io.nexcl)
+        events |= EPOLLEXCLUSIVE;
+    return (events);
+}
+
+/* Bring the kernel's view of fd in line with its attached events. */
+static int
+epoll_apply(struct epollop *epollop, int fd)
+{
+    struct evepoll *evep = &epollop->fds[fd];
+    struct epoll_event epev = {0, {0}};
+    int op, events, dropped;
+
+    /* A queued delete and re-add cancel out while the fd keeps another
+     * event.  Once it lost every event it may have been closed and
+     * reopened in between, which drops the kernel's registration, so
+     * that case pays one MOD, falling back to an ADD, to find out. */
+    events = epoll_wanted(evep);
+    dropped = evep->dropped;
+    evep->dropped = 0;
+    if (events == evep->registered && !(dropped && events))
+        return (0);
+
+    if (evep->registered == 0)
+        op = EPOLL_CTL_ADD;
+    else if (events == 0)
+        op = EPOLL_CTL_DEL;
+    else
+        op = EPOLL_CTL_MOD;
+
+    /* the kernel refuses EPOLL_CTL_MOD on exclusive registrations, so
+     * those get deleted and added again */
+    if (op == EPOLL_CTL_MOD &&
+            ((events | evep->registered) & EPOLLEXCLUSIVE)) {
+        epollop->base->backend_syscalls++;
+        if (epoll_ctl(epollop->epfd, EPOLL_CTL_DEL, fd, &epev) == -1 &&
+                errno != ENOENT)
+            return (-1);
+        evep->registered = 0;
+        op = EPOLL_CTL_ADD;
+    }
+
+    epev.data.fd = fd;
+    epev.events = events;
+    epollop->base->backend_syscalls++;
+    if (epoll_ctl(epollop->epfd, op, fd, &epev) == -1) {
+        /* the fd may have been closed, and maybe reopened, behind our
+         * back; either way the kernel no longer has it registered */
+        if (errno == ENOENT || errno == EBADF)
+            evep->registered = 0;
+        if (op == EPOLL_CTL_MOD && errno == ENOENT)
+            op = EPOLL_CTL_ADD;
+        else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+            op = EPOLL_CTL_MOD;
+        else if (op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF))
+            op = -1;
+        else
+            return (-1);
+        if (op != -1) {
+            epollop->base->backend_syscalls++;
+            if (epoll_ctl(epollop->epfd, op, fd, &epev) == -1)
+                return (-1);
+        }
+    }
+    evep->registered = events;
+    return (0);
+}
+
+/* Remember that fd needs epoll_apply() before the next epoll_wait. */
+static int
+epoll_queue_change(struct epollop *epollop, int fd)
+{
+    struct evepoll *evep = &epollop->fds[fd];
+
+    if (evep->changed)
+        return (0);
+
+    if (epollop->nchanges == epollop->changes_size) {
+        int new_size = epollop->changes_size ? epollop->changes_size * 2 :
+            INITIAL_NEVENTS;
+        int *changes = realloc(epollop->changes, new_size * sizeof(int));
+        if (changes == NULL) {
+            event_warn("realloc");
+            return (-1);
+        }
+        epollop->changes = changes;
+        epollop->changes_size = new_size;
+    }
+    epollop->changes[epollop->nchanges++] = fd;
+    evep->changed = 1;
+    return (0);
+}
+
+/* Push all pending interest changes to the kernel; changes that cancelled
+ * out since they were queued cost nothing. */
+static void
+epoll_apply_changes(struct epollop *epollop)
+{
+    int i, fd;
+
+    for (i = 0; i < epollop->nchanges; i++) {
+        fd = epollop->changes[i];
+        epollop->fds[fd].changed = 0;
+        if (epoll_apply(epollop, fd) == -1)
+            event_warn("epoll_ctl: fd %d", fd);
+    }
+    epollop->nchanges = 0;
+}
+
 static int 
 epoll_add    (void *arg, struct event *ev)
 {
     struct epollop *epollop = arg;
-    struct epoll_event epev = {0, {0}};
     struct evepoll *evep;
-    int fd, op, events;
+    int fd;
 
     if (ev->ev_events & EV_SIGNAL)
         return (evsignal_add(ev));
@@ -156,43 +360,25 @@ epoll_add    (void *arg, struct event *ev)
             return (-1);
     }
     evep = &epollop->fds[fd];
-    op = EPOLL_CTL_ADD;
-    events = 0;
-    if (evep->evread != NULL) {
-        events |= EPOLLIN;
-        op = EPOLL_CTL_MOD;
-    }
-    if (evep->evwrite != NULL) {
-        events |= EPOLLOUT;
-        op = EPOLL_CTL_MOD;
-    }
+    evmap_io_add(&evep->io, ev);
 
-    if (ev->ev_events & EV_READ)
-        events |= EPOLLIN;
-    if (ev->ev_events & EV_WRITE)
-        events |= EPOLLOUT;
+    /* epoll_apply() skips the syscall when the combined mask is unchanged */
+    if (epollop->use_changelist) {
+        if (epoll_queue_change(epollop, fd) == 0)
+            return (0);
+    } else if (epoll_apply(epollop, fd) == 0)
+        return (0);
 
-    epev.data.fd = fd;
-    epev.events = events;
-    if (epoll_ctl(epollop->epfd, op, ev->ev_fd, &epev) == -1)
-        return (-1);
-    /* Update events responsible */
-    if (ev->ev_events & EV_READ)
-        evep->evread = ev;
-    if (ev->ev_events & EV_WRITE)
-        evep->evwrite = ev;
-    return (0);
+    evmap_io_del(&evep->io, ev);
+    return (-1);
 }
 
 static int 
 epoll_del    (void *arg, struct event *ev)
 {
-
     struct epollop *epollop = arg;
-    struct epoll_event epev = {0, {0}};
     struct evepoll *evep;
-    int fd, events, op;
-    int needwritedelete = 1, needreaddelete = 1;
+    int fd;
 
     if (ev->ev_events & EV_SIGNAL)
         return (evsignal_del(ev));
@@ -202,39 +388,47 @@ epoll_del    (void *arg, struct event *ev)
         return (0);
     evep = &epollop->fds[fd];
 
-    op = EPOLL_CTL_DEL;
-    events = 0;
-
-    if (ev->ev_events & EV_READ)
-        events |= EPOLLIN;
-    if (ev->ev_events & EV_WRITE)
-        events |= EPOLLOUT;
+    evmap_io_del(&evep->io, ev);
 
-    if ((events & (EPOLLIN|EPOLLOUT)) != (EPOLLIN|EPOLLOUT)) {
-        if ((events & EPOLLIN) && evep->evwrite != NULL) {
-            needwritedelete = 0;
-            events = EPOLLOUT;
-            op = EPOLL_CTL_MOD;
-        } else if ((events & EPOLLOUT) && evep->evread != NULL) {
-            needreaddelete = 0;
-            events = EPOLLIN;
-            op = EPOLL_CTL_MOD;
-        }
+    if (epollop->use_changelist) {
+        if (evep->io.nevents == 0)
+            evep->dropped = 1;
+        return (epoll_queue_change(epollop, fd));
     }
+    return (epoll_apply(epollop, fd));
+}
 
-    epev.events = events;
-    epev.data.fd = fd;
 
-    if (needreaddelete)
-        evep->evread = NULL;
-    if (needwritedelete)
-        evep->evwrite = NULL;
-    if (epoll_ctl(epollop->epfd, op, fd, &epev) == -1)
-        return (-1);
-    return (0);
+/* Wait for a timeout with a sub-millisecond part without rounding it up. */
+static int
+epoll_wait_hires(struct epollop *epollop, struct timeval *tv, int timeout)
+{
+    struct itimerspec its;
 
-}
+    switch (epollop->hires) {
+#ifdef HAVE_EPOLL_PWAIT2
+    case EPOLL_HIRES_PWAIT2: {
+        struct timespec ts;
 
+        ts.tv_sec = tv->tv_sec;
+        ts.tv_nsec = tv->tv_usec * 1000;
+        return (epoll_pwait2(epollop->epfd, epollop->events,
+                    epollop->nevents, &ts, NULL));
+    }
+#endif
+    case EPOLL_HIRES_TIMERFD:
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = tv->tv_sec;
+        its.it_value.tv_nsec = tv->tv_usec * 1000;
+        epollop->base->backend_syscalls++;
+        if (timerfd_settime(epollop->timerfd, 0, &its, NULL) == 0)
+            return (epoll_wait(epollop->epfd, epollop->events,
+                        epollop->nevents, -1));
+        break;
+    }
+    return (epoll_wait(epollop->epfd, epollop->events, epollop->nevents,
+                timeout));
+}
 
 static int 
 epoll_dispatch   (struct event_base *base, void *arg, struct timeval *tv)
@@ -254,7 +448,18 @@ epoll_dispatch   (struct event_base *base, void *arg, struct timeval *tv)
         timeout = MAX_EPOLL_TIMEOUT_MSEC;
     }
 
-    res = epoll_wait(epollop->epfd, events, epollop->nevents, timeout);
+    if (epollop->nchanges)
+        epoll_apply_changes(epollop);
+
+    /* let other threads add and delete events while we sleep */
+    EVBASE_RELEASE_LOCK(base);
+    if (tv == NULL || tv->tv_usec % 1000 == 0 ||
+            timeout >= MAX_EPOLL_TIMEOUT_MSEC)
+        res = epoll_wait(epollop->epfd, events, epollop->nevents, timeout);
+    else
+        res = epoll_wait_hires(epollop, tv, timeout);
+    EVBASE_ACQUIRE_LOCK(base);
+    base->backend_syscalls++;
 
     if (res == -1) {
         if (errno != EINTR) {
@@ -269,36 +474,33 @@ epoll_dispatch   (struct event_base *base, void *arg, struct timeval *tv)
     }
 
     event_debug(("%s: epoll_wait reports %d", __func__, res));
+    EVENT_STATS_EVENTS(base, res);
 
     for (i = 0; i < res; i++) {
         int what = events[i].events;
-        struct event *evread = NULL, *evwrite = NULL;
+        short ready = 0;
         int fd = events[i].data.fd;
 
+        if (fd == epollop->timerfd) {
+            uint64_t expirations;
+            (void)read(fd, &expirations, sizeof(expirations));
+            continue;
+        }
         if (fd < 0 || fd >= epollop->nfds)
             continue;
         evep = &epollop->fds[fd];
 
         if (what & (EPOLLHUP|EPOLLERR)) {
-            evread = evep->evread;
-            evwrite = evep->evwrite;
+            ready = EV_READ | EV_WRITE;
         } else {
-            if (what & EPOLLIN) {
-                evread = evep->evread;
-            }
-
-            if (what & EPOLLOUT) {
-                evwrite = evep->evwrite;
-            }
+            if (what & EPOLLIN)
+                ready |= EV_READ;
+            if (what & EPOLLOUT)
+                ready |= EV_WRITE;
         }
 
-        if (!(evread||evwrite))
-            continue;
-
-        if (evread != NULL)
-            event_active(evread, EV_READ, 1);
-        if (evwrite != NULL)
-            event_active(evwrite, EV_WRITE, 1);
+        if (ready)
+            evmap_io_active(&evep->io, ready);
     }
 
     if (res == epollop->nevents && epollop->nevents < MAX_NEVENTS) {
@@ -334,6 +536,10 @@ epoll_dealloc   (struct event_base *base, void *arg)
         free(epollop->fds);
     if (epollop->events)
         free(epollop->events);
+    if (epollop->changes)
+        free(epollop->changes);
+    if (epollop->timerfd >= 0)
+        close(epollop->timerfd);
     if (epollop->epfd >= 0)
         close(epollop->epfd);
 
@@ -1,12 +1,19 @@
 #ifndef _EVENT_INTERNAL_H_
 #define _EVENT_INTERNAL_H_
 
+#include <pthread.h>
+#include <time.h>
+
 #include "min_heap.h"
+#include "min_heap4.h"
+#include "timewheel.h"
 #include "evsignal.h"
 
 
 
 
+struct event_io;
+
 struct eventop {
     const char *name;
     void *(*init)(struct event_base *);
@@ -16,10 +23,41 @@ struct eventop {
     void (*dealloc)(struct event_base *, void *);
     /* set if we need to reinitialize the event base */
     int need_reinit;
+    /* completion-based I/O; NULL if the backend only reports readiness */
+    int (*submit_io)(void *, struct event_io *);
+    int (*register_buffers)(void *, const struct iovec *, int);
+    int (*register_fd)(void *, int, int);
+};
+
+/* A pending event_base_read() or event_base_write().  The backend stores
+ * the result in res and activates ev to run the callback on the loop. */
+struct event_io {
+    struct event ev;
+    int fd;
+    int write;
+    void *buf;
+    size_t len;
+    ssize_t res;
+    event_io_cb cb;
+    void *cbarg;
 };
 
 
 
+/* Events sharing one duration, kept in deadline order; only the internal
+ * timeout_event, armed for the head's deadline, sits in the timer store. */
+struct common_timeout_list {
+    struct event_list events;
+    struct timeval duration;    /* handle handed out to the user */
+    struct event timeout_event;
+    struct event_base *base;
+};
+
+#define MAX_COMMON_TIMEOUTS 256
+
+/* ev_timeout is a deadline in a common timeout list, not the timer store */
+#define EVLIST_X_COMMON_TIMEOUT 0x1000
+
 struct event_base {
     const struct eventop *evsel;
     void *evbase;
@@ -32,6 +70,19 @@ struct event_base {
     /* active event management */
     struct event_list **activequeues;
     int nactivequeues;
+    /* bit n of activemap is set while activequeues[n] is non-empty */
+    uint64_t *activemap;
+    int nactivemap;
+
+    /* per-iteration limits, see event_base_set_max_dispatch() */
+    int max_dispatch_callbacks;
+    struct timeval max_dispatch_time;
+    int *priority_weights;
+
+    /* NULL unless event_base_enable_stats() turned them on */
+    struct event_base_stats *stats;
+    /* NULL unless event_base_set_slow_callback() set a threshold */
+    struct event_slow_detector *slow;
 
     /* signal handling info */
     struct evsignal_info sig;
@@ -39,11 +90,116 @@ struct event_base {
     struct event_list eventqueue;
     struct timeval event_tv;
 
+    /* timer store selected by event_base_set_timeout_method() */
+    int timeout_method;
     struct min_heap timeheap;
+    struct min_heap4 timeheap4;
+    struct timewheel *timewheel;
+
+    struct common_timeout_list **common_timeout_queues;
+    int n_common_timeouts;
+
+    /* set up by event_base_use_threads() */
+    int th_enabled;
+    pthread_mutex_t th_base_lock;
+    pthread_t th_owner_id;      /* thread running the loop */
+    int running_loop;
+    int th_notify_fd;           /* eventfd that wakes the loop */
+    struct event th_notify;
+    int is_notify_pending;
 
     struct timeval tv_cache;
+
+    /* set by event_base_set_clock() */
+    int clock_source;
+    /* EVENT_CLOCK_TSC: ns = mono_anchor + ((tsc - tsc_anchor) * tsc_mult
+     * >> 32), re-anchored against CLOCK_MONOTONIC about once a second */
+    uint64_t tsc_first, tsc_anchor, tsc_mult, tsc_recal;
+    uint64_t mono_first, mono_anchor, tsc_last_ns;
+
+    /* wall clock minus the loop's clock, for event_base_gettimeofday_cached() */
+    struct timeval tv_clock_diff;
+    time_t last_updated_clock_diff;
+
+    /* system calls made by the backend, see event_base_get_backend_syscalls() */
+    unsigned long backend_syscalls;
+
+    /* event_base_read()/event_base_write() requests not yet called back */
+    int n_pending_io;
+
+    /* evthreadpool jobs submitted whose done callback has not run yet */
+    int n_pending_jobs;
+
+    /* backing store of event_new(); free events are linked by ev_next */
+    struct event_slab *event_slabs;
+    struct event *event_freelist;
+};
+
+static inline uint64_t
+event_stats_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static inline int
+event_stats_bucket(uint64_t v)
+{
+    int b = v ? 64 - __builtin_clzll(v) : 0;
+
+    return (b < EVENT_STATS_NBUCKETS ? b : EVENT_STATS_NBUCKETS - 1);
+}
+
+/* Open-addressed table of event_callback_total keyed on the callback. */
+struct event_slow_detector {
+    uint64_t threshold;             /* ns */
+    event_slow_cb hook;
+    void *hookarg;
+    struct event_callback_total *totals;
+    unsigned size;                  /* slots, a power of two */
+    unsigned ntotals;               /* slots in use */
+};
+
+#define EVENT_SLOW_HASH(cb)                                     \
+    ((unsigned)(((uint64_t)(uintptr_t)(cb) * 0x9e3779b97f4a7c15ull) >> 32))
+
+/* Backends report how many events each wait returned. */
+#define EVENT_STATS_EVENTS(base, n) do {                            \
+    if ((base)->stats) {                                            \
+        (base)->stats->events_returned += (n);                      \
+        (base)->stats->hist_events[event_stats_bucket(n)]++;        \
+    }                                                               \
+} while (0)
+
+/* Slabs are aligned to their size, so an event finds its slab, and from
+ * there its base, by masking its own address. */
+#define EVENT_SLAB_SIZE 16384
+
+struct event_slab {
+    struct event_base *base;
+    struct event_slab *next;
+    struct event events[];
 };
 
+#define EVENT_SLAB_NEVENTS                                      \
+    ((EVENT_SLAB_SIZE - sizeof(struct event_slab)) / sizeof(struct event))
+#define EVENT_SLAB_OF(ev)                                       \
+    ((struct event_slab *)((uintptr_t)(ev) & ~(uintptr_t)(EVENT_SLAB_SIZE - 1)))
+
+
+/* The base lock is recursive: public calls made from inside the loop,
+ * e.g. event_del() in a callback, just take it again. */
+#define EVBASE_ACQUIRE_LOCK(base) do {                  \
+    if ((base)->th_enabled)                             \
+        pthread_mutex_lock(&(base)->th_base_lock);      \
+} while (0)
+
+#define EVBASE_RELEASE_LOCK(base) do {                  \
+    if ((base)->th_enabled)                             \
+        pthread_mutex_unlock(&(base)->th_base_lock);    \
+} while (0)
 
 #endif /* _EVENT_INTERNAL_H_ */
 
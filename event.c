@@ -1,19 +1,29 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 
 #include "event.h"
 #include "event-internal.h"
 #include "log.h"
 #include "evutil.h"
 #include "min_heap.h"
+#include "min_heap4.h"
+#include "timewheel.h"
 
 extern const struct eventop epollops;
+extern const struct eventop iouringops;
 
 /* In order of preference */
 static const struct eventop *eventops[] = {
     &epollops,
+    &iouringops,
     NULL
 };
 
@@ -23,7 +33,6 @@ static const struct eventop *eventops[] = {
 
 /* Global state */
 struct event_base *current_base = NULL;
-extern struct event_base *evsignal_base;
 static int use_monotonic;
 
 /* Prototypes */
@@ -33,12 +42,36 @@ static int	event_haveevents(struct event_base *);
 
 static void	event_process_active(struct event_base *);
 
+static int	event_add_nolock(struct event *, const struct timeval *);
+static int	event_del_nolock(struct event *);
+static void	event_active_nolock(struct event *, int, short);
+static void	evthread_notify_base(struct event_base *);
+
 
 
 static int	timeout_next(struct event_base *, struct timeval **);
 static void	timeout_process(struct event_base *);
 static void	timeout_correct(struct event_base *, struct timeval *);
 
+static void	common_timeout_schedule(struct common_timeout_list *,
+		    struct event *);
+static void	common_timeout_process(struct common_timeout_list *,
+		    const struct timeval *);
+static void	common_timeout_callback(int, short, void *);
+
+/*
+ * A common timeout handle is a timeval whose tv_usec carries a magic
+ * value and the index of its list above the microsecond bits.
+ */
+#define COMMON_TIMEOUT_MICROSECONDS_MASK	0x000fffff
+#define COMMON_TIMEOUT_IDX_MASK		0x0ff00000
+#define COMMON_TIMEOUT_IDX_SHIFT	20
+#define COMMON_TIMEOUT_MASK		0xf0000000
+#define COMMON_TIMEOUT_MAGIC		0x50000000
+
+#define COMMON_TIMEOUT_IDX(tv) \
+	(((tv)->tv_usec & COMMON_TIMEOUT_IDX_MASK) >> COMMON_TIMEOUT_IDX_SHIFT)
+
 
 
 
@@ -49,21 +82,168 @@ detect_monotonic(void)
     use_monotonic = 1;
 }
 
+/* seconds between refreshes of the wall clock offset */
+#define CLOCK_SYNC_INTERVAL 5
+/* callbacks run between reads of the clock for the time slice */
+#define DISPATCH_CLOCK_INTERVAL 8
+
+static inline uint64_t
+clock_nsec(clockid_t id)
+{
+    struct timespec ts;
+
+    if (clock_gettime(id, &ts) == -1)
+        return (0);
+    return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+
+/* Only an invariant TSC ticks at a fixed rate through P- and C-states. */
+static int
+tsc_is_invariant(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return (0);
+    return ((edx & (1 << 8)) != 0);
+}
+
+/* Tie the TSC to CLOCK_MONOTONIC over a short busy-wait. */
+static int
+tsc_calibrate(struct event_base *base)
+{
+    uint64_t tsc0, tsc1, ns0, ns1;
+
+    ns0 = clock_nsec(CLOCK_MONOTONIC);
+    tsc0 = __rdtsc();
+    do {
+        ns1 = clock_nsec(CLOCK_MONOTONIC);
+    } while (ns1 - ns0 < 2000000);
+    tsc1 = __rdtsc();
+    if (tsc1 <= tsc0)
+        return (-1);
+
+    base->tsc_mult = ((ns1 - ns0) << 32) / (tsc1 - tsc0);
+    base->tsc_first = base->tsc_anchor = tsc1;
+    base->mono_first = base->mono_anchor = base->tsc_last_ns = ns1;
+    /* cycles per second, near enough */
+    base->tsc_recal = (tsc1 - tsc0) * (1000000000 / (ns1 - ns0));
+    return (0);
+}
+
+static uint64_t
+tsc_nsec(struct event_base *base)
+{
+    uint64_t tsc = __rdtsc(), ns;
+
+    if (tsc - base->tsc_anchor >= base->tsc_recal) {
+        /* refine the rate over everything seen so far, re-anchor */
+        ns = clock_nsec(CLOCK_MONOTONIC);
+        base->tsc_mult = ((unsigned __int128)(ns - base->mono_first) << 32) /
+            (tsc - base->tsc_first);
+        base->tsc_anchor = tsc;
+        base->mono_anchor = ns;
+    } else {
+        ns = base->mono_anchor + (uint64_t)(((unsigned __int128)
+                    (tsc - base->tsc_anchor) * base->tsc_mult) >> 32);
+    }
+
+    /* re-anchoring may step back a little; never let the clock do so */
+    if (ns < base->tsc_last_ns)
+        ns = base->tsc_last_ns;
+    base->tsc_last_ns = ns;
+    return (ns);
+}
+#endif
+
+/* Switch the clock behind the loop; all sources count from the same
+ * origin as CLOCK_MONOTONIC, so pending timeouts stay valid. */
+int
+event_base_set_clock(struct event_base *base, int source)
+{
+    struct timespec ts;
+    int res = 0;
+
+    EVBASE_ACQUIRE_LOCK(base);
+    switch (source) {
+        case EVENT_CLOCK_MONOTONIC:
+            break;
+        case EVENT_CLOCK_COARSE:
+            if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == -1)
+                res = -1;
+            break;
+        case EVENT_CLOCK_TSC:
+#ifdef HAVE_TSC
+            if (!tsc_is_invariant() || tsc_calibrate(base) == -1)
+                res = -1;
+#else
+            res = -1;
+#endif
+            break;
+        default:
+            res = -1;
+    }
+    if (res == 0)
+        base->clock_source = source;
+    EVBASE_RELEASE_LOCK(base);
+    return (res);
+}
+
 static int
 gettime(struct event_base *base, struct timeval *tp)
 {
+    uint64_t ns;
+
     if (base->tv_cache.tv_sec) {
         *tp = base->tv_cache;
         return (0);
     }
-    if (use_monotonic) {
-        struct timespec ts;
-        if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
-            return (-1);
-        tp->tv_sec = ts.tv_sec;
-        tp->tv_usec = ts.tv_nsec / 1000;
-        return (0);
+
+    switch (base->clock_source) {
+#ifdef HAVE_TSC
+        case EVENT_CLOCK_TSC:
+            ns = tsc_nsec(base);
+            break;
+#endif
+        case EVENT_CLOCK_COARSE:
+            ns = clock_nsec(CLOCK_MONOTONIC_COARSE);
+            break;
+        default:
+            ns = clock_nsec(CLOCK_MONOTONIC);
     }
+    if (ns == 0)
+        return (-1);
+    tp->tv_sec = ns / 1000000000;
+    tp->tv_usec = (ns % 1000000000) / 1000;
+
+    /* keep event_base_gettimeofday_cached() close to the wall clock */
+    if (tp->tv_sec >= base->last_updated_clock_diff + CLOCK_SYNC_INTERVAL) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        evutil_timersub(&tv, tp, &base->tv_clock_diff);
+        base->last_updated_clock_diff = tp->tv_sec;
+    }
+    return (0);
+}
+
+/* Wall-clock time of the loop's cached timestamp, so callbacks need not
+ * make their own call; the current time when nothing is cached. */
+int
+event_base_gettimeofday_cached(struct event_base *base, struct timeval *tv)
+{
+    EVBASE_ACQUIRE_LOCK(base);
+    if (base->tv_cache.tv_sec == 0) {
+        EVBASE_RELEASE_LOCK(base);
+        return (gettimeofday(tv, NULL));
+    }
+    evutil_timeradd(&base->tv_cache, &base->tv_clock_diff, tv);
+    EVBASE_RELEASE_LOCK(base);
+    return (0);
 }
 
 
@@ -92,6 +272,7 @@ event_base_new(void)
     gettime(base, &base->event_tv);
 
     min_heap_ctor(&base->timeheap);
+    min_heap4_ctor(&base->timeheap4);
     TAILQ_INIT(&base->eventqueue);
     base->sig.ev_signal_pair[0] = -1;
     base->sig.ev_signal_pair[1] = -1;
@@ -116,6 +297,306 @@ event_base_new(void)
     return (base);
 }
 
+static inline int
+is_common_timeout(const struct timeval *tv, const struct event_base *base)
+{
+    if ((tv->tv_usec & COMMON_TIMEOUT_MASK) != COMMON_TIMEOUT_MAGIC)
+        return (0);
+    return (COMMON_TIMEOUT_IDX(tv) < base->n_common_timeouts);
+}
+
+const struct timeval *
+event_base_init_common_timeout(struct event_base *base,
+        const struct timeval *duration)
+{
+    struct common_timeout_list *ctl, **queues;
+    struct timeval tv;
+    int i;
+
+    tv = *duration;
+    if (is_common_timeout(&tv, base))
+        tv.tv_usec &= COMMON_TIMEOUT_MICROSECONDS_MASK;
+    if (tv.tv_usec >= 1000000) {
+        tv.tv_sec += tv.tv_usec / 1000000;
+        tv.tv_usec %= 1000000;
+    }
+
+    for (i = 0; i < base->n_common_timeouts; ++i) {
+        ctl = base->common_timeout_queues[i];
+        if (ctl->duration.tv_sec == tv.tv_sec &&
+                (ctl->duration.tv_usec & COMMON_TIMEOUT_MICROSECONDS_MASK) ==
+                tv.tv_usec)
+            return (&ctl->duration);
+    }
+
+    if (base->n_common_timeouts == MAX_COMMON_TIMEOUTS) {
+        event_warn("%s: too many common timeouts", __func__);
+        return (NULL);
+    }
+
+    queues = realloc(base->common_timeout_queues,
+            (base->n_common_timeouts + 1) * sizeof(*queues));
+    if (queues == NULL) {
+        event_warn("%s: realloc", __func__);
+        return (NULL);
+    }
+    base->common_timeout_queues = queues;
+
+    if ((ctl = calloc(1, sizeof(struct common_timeout_list))) == NULL) {
+        event_warn("%s: calloc", __func__);
+        return (NULL);
+    }
+    TAILQ_INIT(&ctl->events);
+    ctl->duration.tv_sec = tv.tv_sec;
+    ctl->duration.tv_usec = tv.tv_usec | COMMON_TIMEOUT_MAGIC |
+        (base->n_common_timeouts << COMMON_TIMEOUT_IDX_SHIFT);
+    evtimer_set(&ctl->timeout_event, common_timeout_callback, ctl);
+    ctl->timeout_event.ev_base = base;
+    ctl->timeout_event.ev_flags |= EVLIST_INTERNAL;
+    ctl->base = base;
+    queues[base->n_common_timeouts++] = ctl;
+
+    return (&ctl->duration);
+}
+
+int
+event_base_set_timeout_method(struct event_base *base, int method)
+{
+    struct timeval now;
+
+    /* pending timeouts would have to be migrated */
+    if (min_heap_size(&base->timeheap) || min_heap4_size(&base->timeheap4) ||
+            (base->timewheel && timewheel_size(base->timewheel)))
+        return (-1);
+
+    switch (method) {
+        case EVENT_TIMEOUT_HEAP:
+        case EVENT_TIMEOUT_HEAP4:
+            if (base->timewheel) {
+                timewheel_free(base->timewheel);
+                base->timewheel = NULL;
+            }
+            break;
+        case EVENT_TIMEOUT_WHEEL:
+            if (base->timewheel)
+                break;
+            gettime(base, &now);
+            if ((base->timewheel = timewheel_new(&now)) == NULL)
+                return (-1);
+            break;
+        default:
+            return (-1);
+    }
+    base->timeout_method = method;
+    return (0);
+}
+
+const char *
+event_base_get_method(struct event_base *base)
+{
+    return (base->evsel->name);
+}
+
+unsigned long
+event_base_get_backend_syscalls(struct event_base *base)
+{
+    return (base->backend_syscalls);
+}
+
+static void
+evthread_notify_drain(int fd, short what, void *arg)
+{
+    struct event_base *base = arg;
+    uint64_t counter;
+
+    EVBASE_ACQUIRE_LOCK(base);
+    (void)read(fd, &counter, sizeof(counter));
+    base->is_notify_pending = 0;
+    EVBASE_RELEASE_LOCK(base);
+}
+
+/*
+ * Make event_add, event_del and event_active safe to call from any
+ * thread.  Must be called before the loop starts running.
+ */
+int
+event_base_use_threads(struct event_base *base)
+{
+    pthread_mutexattr_t attr;
+    int fd;
+
+    if (base->th_enabled)
+        return (0);
+
+    if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        event_warn("%s: eventfd", __func__);
+        return (-1);
+    }
+
+    event_set(&base->th_notify, fd, EV_READ | EV_PERSIST,
+            evthread_notify_drain, base);
+    base->th_notify.ev_base = base;
+    base->th_notify.ev_flags |= EVLIST_INTERNAL;
+    base->th_notify.ev_pri = 0;
+    if (event_add(&base->th_notify, NULL) == -1) {
+        close(fd);
+        return (-1);
+    }
+    base->th_notify_fd = fd;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&base->th_base_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    base->th_enabled = 1;
+    return (0);
+}
+
+/* True if a change must wake a loop blocked in another thread. */
+static inline int
+evthread_need_notify(struct event_base *base)
+{
+    return (base->th_enabled && base->running_loop &&
+            !pthread_equal(base->th_owner_id, pthread_self()));
+}
+
+static void
+evthread_notify_base(struct event_base *base)
+{
+    uint64_t one = 1;
+
+    if (base->is_notify_pending)
+        return;
+    base->is_notify_pending = 1;
+    if (write(base->th_notify_fd, &one, sizeof(one)) == -1)
+        event_warn("%s: write", __func__);
+}
+
+static inline int
+timeout_store_reserve(struct event_base *base)
+{
+    switch (base->timeout_method) {
+        case EVENT_TIMEOUT_HEAP:
+            return (min_heap_reserve(&base->timeheap,
+                        1 + min_heap_size(&base->timeheap)));
+        case EVENT_TIMEOUT_HEAP4:
+            return (min_heap4_reserve(&base->timeheap4,
+                        1 + min_heap4_size(&base->timeheap4)));
+        default:
+            return (0);
+    }
+}
+
+static inline void
+timeout_store_push(struct event_base *base, struct event *ev)
+{
+    switch (base->timeout_method) {
+        case EVENT_TIMEOUT_HEAP:
+            min_heap_push(&base->timeheap, ev);
+            break;
+        case EVENT_TIMEOUT_HEAP4:
+            min_heap4_push(&base->timeheap4, ev);
+            break;
+        case EVENT_TIMEOUT_WHEEL:
+            timewheel_add(base->timewheel, ev);
+            break;
+    }
+}
+
+static inline void
+timeout_store_erase(struct event_base *base, struct event *ev)
+{
+    switch (base->timeout_method) {
+        case EVENT_TIMEOUT_HEAP:
+            min_heap_erase(&base->timeheap, ev);
+            break;
+        case EVENT_TIMEOUT_HEAP4:
+            min_heap4_erase(&base->timeheap4, ev);
+            break;
+        case EVENT_TIMEOUT_WHEEL:
+            timewheel_del(base->timewheel, ev);
+            break;
+    }
+}
+
+/* Earliest timeout of the heap stores; the wheel has no cheap top. */
+static inline struct event *
+timeout_store_top(struct event_base *base)
+{
+    if (base->timeout_method == EVENT_TIMEOUT_HEAP4)
+        return (min_heap4_top(&base->timeheap4));
+    return (min_heap_top(&base->timeheap));
+}
+
+static unsigned
+timeout_store_size(struct event_base *base)
+{
+    switch (base->timeout_method) {
+        case EVENT_TIMEOUT_WHEEL:
+            return (timewheel_size(base->timewheel));
+        case EVENT_TIMEOUT_HEAP4:
+            return (min_heap4_size(&base->timeheap4));
+        default:
+            return (min_heap_size(&base->timeheap));
+    }
+}
+
+/* Release what the base itself owns; user events are left alone. */
+void
+event_base_free(struct event_base *base)
+{
+    int i;
+
+    if (base == NULL)
+        return;
+    if (base == current_base)
+        current_base = NULL;
+
+    if (base->th_enabled) {
+        event_del(&base->th_notify);
+        close(base->th_notify_fd);
+        base->th_enabled = 0;
+        pthread_mutex_destroy(&base->th_base_lock);
+    }
+
+    for (i = 0; i < base->n_common_timeouts; ++i) {
+        struct common_timeout_list *ctl = base->common_timeout_queues[i];
+
+        if (ctl->timeout_event.ev_flags & EVLIST_TIMEOUT)
+            event_queue_remove(base, &ctl->timeout_event, EVLIST_TIMEOUT);
+        free(ctl);
+    }
+    free(base->common_timeout_queues);
+
+    if (base->evsel->dealloc != NULL)
+        base->evsel->dealloc(base, base->evbase);
+
+    for (i = 0; i < base->nactivequeues; ++i)
+        free(base->activequeues[i]);
+    free(base->activequeues);
+    free(base->activemap);
+    free(base->priority_weights);
+    free(base->stats);
+    if (base->slow != NULL) {
+        free(base->slow->totals);
+        free(base->slow);
+    }
+
+    min_heap_dtor(&base->timeheap);
+    min_heap4_dtor(&base->timeheap4);
+    if (base->timewheel)
+        timewheel_free(base->timewheel);
+
+    /* events from event_new() go with their base */
+    while (base->event_slabs != NULL) {
+        struct event_slab *slab = base->event_slabs;
+        base->event_slabs = slab->next;
+        free(slab);
+    }
+
+    free(base);
+}
+
 int
 event_base_priority_init(struct event_base *base, int npriorities)
 {
@@ -127,6 +608,10 @@ event_base_priority_init(struct event_base *base, int npriorities)
             free(base->activequeues[i]);
         }
         free(base->activequeues);
+        free(base->activemap);
+        /* one weight per priority; they no longer line up */
+        free(base->priority_weights);
+        base->priority_weights = NULL;
     }
     /* Allocate our priority queues */
     base->nactivequeues = npriorities;
@@ -140,6 +625,10 @@ event_base_priority_init(struct event_base *base, int npriorities)
             event_err(1, "%s: malloc", __func__);
         TAILQ_INIT(base->activequeues[i]);
     }
+    base->nactivemap = (npriorities + 63) / 64;
+    base->activemap = calloc(base->nactivemap, sizeof(uint64_t));
+    if (base->activemap == NULL)
+        event_err(1, "%s: calloc", __func__);
     return (0);
 }
 
@@ -165,8 +654,130 @@ event_set(struct event *ev, int fd, short events,
         ev->ev_pri = current_base->nactivequeues/2;
 }
 
+/* Carve one more slab into free events. */
+static int
+event_slab_grow(struct event_base *base)
+{
+    struct event_slab *slab;
+    void *mem;
+    int i;
+
+    if (posix_memalign(&mem, EVENT_SLAB_SIZE, EVENT_SLAB_SIZE))
+        return (-1);
+    slab = mem;
+    slab->base = base;
+    slab->next = base->event_slabs;
+    base->event_slabs = slab;
+
+    for (i = EVENT_SLAB_NEVENTS - 1; i >= 0; i--) {
+        slab->events[i].ev_next.tqe_next = base->event_freelist;
+        base->event_freelist = &slab->events[i];
+    }
+    return (0);
+}
+
+/* Make sure at least n events can be created without allocating. */
+int
+event_base_prealloc_events(struct event_base *base, int n)
+{
+    struct event *ev;
+    int nfree = 0, res = 0;
+
+    EVBASE_ACQUIRE_LOCK(base);
+    for (ev = base->event_freelist; ev != NULL && nfree < n;
+            ev = ev->ev_next.tqe_next)
+        nfree++;
+    for (; nfree < n; nfree += EVENT_SLAB_NEVENTS) {
+        if ((res = event_slab_grow(base)) == -1)
+            break;
+    }
+    EVBASE_RELEASE_LOCK(base);
+    return (res);
+}
+
+/* An event_set() event on base, taken from the base's slabs. */
+struct event *
+event_new(struct event_base *base, int fd, short events,
+        void (*callback)(int, short, void *), void *arg)
+{
+    struct event *ev;
+
+    if (base == NULL)
+        return (NULL);
+
+    EVBASE_ACQUIRE_LOCK(base);
+    if (base->event_freelist == NULL && event_slab_grow(base) == -1) {
+        EVBASE_RELEASE_LOCK(base);
+        return (NULL);
+    }
+    ev = base->event_freelist;
+    base->event_freelist = ev->ev_next.tqe_next;
+    EVBASE_RELEASE_LOCK(base);
+
+    event_set(ev, fd, events, callback, arg);
+    ev->ev_base = base;
+    ev->ev_pri = base->nactivequeues/2;
+    return (ev);
+}
+
+/* Delete an event from event_new() and return it to its slab. */
+void
+event_free(struct event *ev)
+{
+    struct event_base *base;
+
+    if (ev == NULL)
+        return;
+    base = EVENT_SLAB_OF(ev)->base;
+
+    event_del(ev);
+    EVBASE_ACQUIRE_LOCK(base);
+    ev->ev_next.tqe_next = base->event_freelist;
+    base->event_freelist = ev;
+    EVBASE_RELEASE_LOCK(base);
+}
+
+/* Move an event that has not been added yet onto another base. */
+int
+event_base_set(struct event_base *base, struct event *ev)
+{
+    if (ev->ev_flags != EVLIST_INIT)
+        return (-1);
+
+    ev->ev_base = base;
+    ev->ev_pri = base->nactivequeues/2;
+    return (0);
+}
+
+/* Smaller numbers run first; only while the event is not active. */
+int
+event_priority_set(struct event *ev, int pri)
+{
+    if (ev->ev_flags & EVLIST_ACTIVE)
+        return (-1);
+    if (pri < 0 || pri >= ev->ev_base->nactivequeues)
+        return (-1);
+
+    ev->ev_pri = pri;
+    return (0);
+}
+
 int
 event_add(struct event *ev, const struct timeval *tv)
+{
+	struct event_base *base = ev->ev_base;
+	int res;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	res = event_add_nolock(ev, tv);
+	if (res != -1 && evthread_need_notify(base))
+		evthread_notify_base(base);
+	EVBASE_RELEASE_LOCK(base);
+	return (res);
+}
+
+static int
+event_add_nolock(struct event *ev, const struct timeval *tv)
 {
 	struct event_base *base = ev->ev_base;
 	const struct eventop *evsel = base->evsel;
@@ -184,8 +795,7 @@ event_add(struct event *ev, const struct timeval *tv)
 	assert(!(ev->ev_flags & ~EVLIST_ALL));
 
 	if (tv != NULL && !(ev->ev_flags & EVLIST_TIMEOUT)) {
-		if (min_heap_reserve(&base->timeheap,
-					1 + min_heap_size(&base->timeheap)) == -1)
+		if (timeout_store_reserve(base) == -1)
 			return (-1);  /* ENOMEM == errno */
 	}
 
@@ -212,7 +822,17 @@ event_add(struct event *ev, const struct timeval *tv)
 		}
 
 		gettime(base, &now);
-		evutil_timeradd(&now, tv, &ev->ev_timeout);
+		if (is_common_timeout(tv, base)) {
+			struct timeval duration = *tv;
+
+			duration.tv_usec &= COMMON_TIMEOUT_MICROSECONDS_MASK;
+			evutil_timeradd(&now, &duration, &ev->ev_timeout);
+			ev->ev_flags |= EVLIST_X_COMMON_TIMEOUT;
+			ev->min_heap_idx = COMMON_TIMEOUT_IDX(tv);
+		} else {
+			evutil_timeradd(&now, tv, &ev->ev_timeout);
+			ev->ev_flags &= ~EVLIST_X_COMMON_TIMEOUT;
+		}
 		event_debug((
 					"event_add: timeout in %ld seconds, call %p",
 					tv->tv_sec, ev->ev_callback));
@@ -223,6 +843,24 @@ event_add(struct event *ev, const struct timeval *tv)
 
 int
 event_del(struct event *ev)
+{
+	struct event_base *base = ev->ev_base;
+	int res;
+
+	/* An event without a base has not been added */
+	if (base == NULL)
+		return (-1);
+
+	EVBASE_ACQUIRE_LOCK(base);
+	res = event_del_nolock(ev);
+	if (evthread_need_notify(base))
+		evthread_notify_base(base);
+	EVBASE_RELEASE_LOCK(base);
+	return (res);
+}
+
+static int
+event_del_nolock(struct event *ev)
 {
 	struct event_base *base;
 	const struct eventop *evsel;
@@ -231,10 +869,6 @@ event_del(struct event *ev)
 	event_debug(("event_del: %p, callback %p",
 				ev, ev->ev_callback));
 
-	/* An event without a base has not been added */
-	if (ev->ev_base == NULL)
-		return (-1);
-
 	base = ev->ev_base;
 	evsel = base->evsel;
 	evbase = base->evbase;
@@ -265,26 +899,132 @@ event_del(struct event *ev)
 int
 event_haveevents(struct event_base *base)
 {
-		return (base->event_count > 0);
+		return (base->event_count > 0 || base->n_pending_io > 0 ||
+		    base->n_pending_jobs > 0);
 }
 
 
-static void
-event_process_active(struct event_base *base)
+/* First priority at or below from (numerically >=) with active events. */
+static int
+event_next_active_pri(struct event_base *base, int from)
 {
-	struct event *ev;
-	struct event_list *activeq = NULL;
-	int i;
-	short ncalls;
+	int i = from / 64;
+	uint64_t bits;
 
-	for (i = 0; i < base->nactivequeues; ++i) {
-		if (TAILQ_FIRST(base->activequeues[i]) != NULL) {
-			activeq = base->activequeues[i];
-			break;
+	if (from >= base->nactivequeues)
+		return (-1);
+	bits = base->activemap[i] & (~(uint64_t)0 << (from % 64));
+	for (;;) {
+		if (bits)
+			return (i * 64 + __builtin_ctzll(bits));
+		if (++i == base->nactivemap)
+			return (-1);
+		bits = base->activemap[i];
+	}
+}
+
+/* Totals slot for callback, claimed if new; NULL if it cannot grow. */
+static struct event_callback_total *
+event_slow_lookup(struct event_slow_detector *slow,
+    void (*callback)(int, short, void *))
+{
+	struct event_callback_total *t;
+	unsigned i, mask;
+
+	if (2 * (slow->ntotals + 1) > slow->size) {
+		struct event_callback_total *old = slow->totals;
+		unsigned oldsize = slow->size;
+		unsigned size = oldsize ? oldsize * 2 : 64;
+
+		if ((t = calloc(size, sizeof(*t))) == NULL)
+			return (NULL);
+		slow->totals = t;
+		slow->size = size;
+		mask = size - 1;
+		for (i = 0; i < oldsize; i++) {
+			unsigned j;
+			if (old[i].callback == NULL)
+				continue;
+			j = EVENT_SLOW_HASH(old[i].callback) & mask;
+			while (t[j].callback != NULL)
+				j = (j + 1) & mask;
+			t[j] = old[i];
+		}
+		free(old);
+	}
+
+	mask = slow->size - 1;
+	for (i = EVENT_SLOW_HASH(callback) & mask;; i = (i + 1) & mask) {
+		t = &slow->totals[i];
+		if (t->callback == callback)
+			return (t);
+		if (t->callback == NULL) {
+			t->callback = callback;
+			slow->ntotals++;
+			return (t);
 		}
 	}
+}
+
+/* Account a callback that took nsec; called with the lock held. */
+static void
+event_callback_timed(struct event_base *base,
+    void (*callback)(int, short, void *), int fd, short what, uint64_t nsec)
+{
+	struct event_slow_detector *slow = base->slow;
+	struct event_callback_total *t;
+	event_slow_cb hook;
+	void *hookarg;
+
+	if (base->stats) {
+		base->stats->callbacks++;
+		base->stats->nsec_callbacks += nsec;
+		base->stats->hist_callback[event_stats_bucket(nsec)]++;
+	}
+	if (slow == NULL)
+		return;
+
+	if ((t = event_slow_lookup(slow, callback)) != NULL) {
+		t->calls++;
+		t->nsec += nsec;
+		if (nsec > t->nsec_max)
+			t->nsec_max = nsec;
+		if (nsec >= slow->threshold)
+			t->slow++;
+	}
+
+	if (nsec >= slow->threshold && slow->hook != NULL) {
+		hook = slow->hook;
+		hookarg = slow->hookarg;
+		EVBASE_RELEASE_LOCK(base);
+		(*hook)(callback, fd, what, nsec, hookarg);
+		EVBASE_ACQUIRE_LOCK(base);
+	}
+}
+
+/* Refresh the cached time, which callbacks see too; 1 once past endtime. */
+static int
+event_slice_expired(struct event_base *base, const struct timeval *endtime)
+{
+	base->tv_cache.tv_sec = 0;
+	gettime(base, &base->tv_cache);
+	return (evutil_timercmp(&base->tv_cache, endtime, >=));
+}
 
-	assert(activeq != NULL);
+/*
+ * Run callbacks from one active queue until it is empty, max of them
+ * have run (max < 0 means no limit) or endtime has passed.  The clock is
+ * only read every DISPATCH_CLOCK_INTERVAL callbacks, so the slice may be
+ * overrun by that many.  Returns the number run, or -1 if the loop was
+ * asked to break.
+ */
+static int
+event_process_active_queue(struct event_base *base,
+    struct event_list *activeq, int max, const struct timeval *endtime)
+{
+	struct event *ev;
+	short ncalls;
+	int count = 0;
 
 	for (ev = TAILQ_FIRST(activeq); ev; ev = TAILQ_FIRST(activeq)) {
 		if (ev->ev_events & EV_PERSIST)
@@ -298,11 +1038,240 @@ event_process_active(struct event_base *base)
 		while (ncalls) {
 			ncalls--;
 			ev->ev_ncalls = ncalls;
-			(*ev->ev_callback)((int)ev->ev_fd, ev->ev_res, ev->ev_arg);
+			EVBASE_RELEASE_LOCK(base);
+			if (base->stats || base->slow) {
+				void (*cb)(int, short, void *) = ev->ev_callback;
+				int fd = (int)ev->ev_fd;
+				short what = ev->ev_res;
+				uint64_t t0 = event_stats_nsec(), dt;
+
+				(*cb)(fd, what, ev->ev_arg);
+				dt = event_stats_nsec() - t0;
+				EVBASE_ACQUIRE_LOCK(base);
+				event_callback_timed(base, cb, fd, what, dt);
+			} else {
+				(*ev->ev_callback)((int)ev->ev_fd, ev->ev_res,
+				    ev->ev_arg);
+				EVBASE_ACQUIRE_LOCK(base);
+			}
 			if (base->event_break)
-				return;
+				return (-1);
 		}
+
+		if (++count == max)
+			break;
+		if (endtime != NULL && count % DISPATCH_CLOCK_INTERVAL == 0 &&
+		    event_slice_expired(base, endtime))
+			break;
 	}
+	return (count);
+}
+
+/*
+ * Normally only the highest non-empty priority is run per iteration.
+ * With priority weights every active priority gets up to its weight in
+ * callbacks, highest first.  Either way the iteration stops at the
+ * base's callback budget and time slice, if set.
+ */
+static void
+event_process_active(struct event_base *base)
+{
+	struct timeval now, endtime, *endp = NULL;
+	int pri, max, n, budget = base->max_dispatch_callbacks;
+
+	if (evutil_timerisset(&base->max_dispatch_time)) {
+		gettime(base, &now);
+		evutil_timeradd(&now, &base->max_dispatch_time, &endtime);
+		endp = &endtime;
+	}
+
+	pri = event_next_active_pri(base, 0);
+	assert(pri != -1);
+
+	if (base->priority_weights == NULL) {
+		event_process_active_queue(base, base->activequeues[pri],
+		    budget ? budget : -1, endp);
+		return;
+	}
+
+	for (; pri != -1; pri = event_next_active_pri(base, pri + 1)) {
+		max = base->priority_weights[pri];
+		if (budget && max > budget)
+			max = budget;
+		n = event_process_active_queue(base, base->activequeues[pri],
+		    max, endp);
+		if (n == -1)
+			return;
+		if (budget && (budget -= n) == 0)
+			return;
+		if (endp != NULL && event_slice_expired(base, endp))
+			return;
+	}
+}
+
+/*
+ * Time every callback and report those taking threshold or longer to
+ * hook, which may be NULL to only keep the per-callback totals.  A NULL
+ * threshold turns the detector off and drops the totals.
+ */
+int
+event_base_set_slow_callback(struct event_base *base,
+    const struct timeval *threshold, event_slow_cb hook, void *arg)
+{
+    struct event_slow_detector *slow;
+
+    EVBASE_ACQUIRE_LOCK(base);
+    if (threshold == NULL) {
+        if ((slow = base->slow) != NULL) {
+            free(slow->totals);
+            free(slow);
+            base->slow = NULL;
+        }
+        EVBASE_RELEASE_LOCK(base);
+        return (0);
+    }
+
+    if ((slow = base->slow) == NULL &&
+            (slow = calloc(1, sizeof(struct event_slow_detector))) == NULL) {
+        EVBASE_RELEASE_LOCK(base);
+        return (-1);
+    }
+    slow->threshold = (uint64_t)threshold->tv_sec * 1000000000 +
+        (uint64_t)threshold->tv_usec * 1000;
+    slow->hook = hook;
+    slow->hookarg = arg;
+    base->slow = slow;
+    EVBASE_RELEASE_LOCK(base);
+    return (0);
+}
+
+static int
+event_callback_total_cmp(const void *a, const void *b)
+{
+    const struct event_callback_total *x = a, *y = b;
+
+    if (x->nsec != y->nsec)
+        return (x->nsec < y->nsec ? 1 : -1);
+    return (0);
+}
+
+/* Copy out up to n per-callback totals, largest total time first.
+ * Returns how many were copied, or -1 if the detector is off. */
+int
+event_base_get_callback_totals(struct event_base *base,
+    struct event_callback_total *out, int n)
+{
+    struct event_slow_detector *slow;
+    struct event_callback_total *all;
+    unsigned i;
+    int k = 0;
+
+    EVBASE_ACQUIRE_LOCK(base);
+    if ((slow = base->slow) == NULL) {
+        EVBASE_RELEASE_LOCK(base);
+        return (-1);
+    }
+    if ((all = malloc((slow->ntotals + 1) * sizeof(*all))) == NULL) {
+        EVBASE_RELEASE_LOCK(base);
+        return (-1);
+    }
+    for (i = 0; i < slow->size; i++)
+        if (slow->totals[i].callback != NULL)
+            all[k++] = slow->totals[i];
+    EVBASE_RELEASE_LOCK(base);
+
+    qsort(all, k, sizeof(*all), event_callback_total_cmp);
+    if (k > n)
+        k = n;
+    memcpy(out, all, k * sizeof(*all));
+    free(all);
+    return (k);
+}
+
+/* Start (or stop and discard) collecting struct event_base_stats. */
+int
+event_base_enable_stats(struct event_base *base, int on)
+{
+    int res = 0;
+
+    EVBASE_ACQUIRE_LOCK(base);
+    if (on && base->stats == NULL) {
+        if ((base->stats = calloc(1, sizeof(struct event_base_stats))) == NULL)
+            res = -1;
+    } else if (!on && base->stats != NULL) {
+        free(base->stats);
+        base->stats = NULL;
+    }
+    EVBASE_RELEASE_LOCK(base);
+    return (res);
+}
+
+/* Copy out the counters; fails if they are not enabled. */
+int
+event_base_get_stats(struct event_base *base, struct event_base_stats *out)
+{
+    int res = -1;
+
+    EVBASE_ACQUIRE_LOCK(base);
+    if (base->stats != NULL) {
+        *out = *base->stats;
+        res = 0;
+    }
+    EVBASE_RELEASE_LOCK(base);
+    return (res);
+}
+
+void
+event_base_reset_stats(struct event_base *base)
+{
+    EVBASE_ACQUIRE_LOCK(base);
+    if (base->stats != NULL)
+        memset(base->stats, 0, sizeof(struct event_base_stats));
+    EVBASE_RELEASE_LOCK(base);
+}
+
+/* Cap the callbacks run, and the time spent running them, per loop
+ * iteration; 0 and NULL mean no limit.  The time is checked every few
+ * callbacks, not after each one. */
+int
+event_base_set_max_dispatch(struct event_base *base, int max_callbacks,
+    const struct timeval *max_interval)
+{
+	if (max_callbacks < 0)
+		return (-1);
+
+	EVBASE_ACQUIRE_LOCK(base);
+	base->max_dispatch_callbacks = max_callbacks;
+	if (max_interval != NULL)
+		base->max_dispatch_time = *max_interval;
+	else
+		evutil_timerclear(&base->max_dispatch_time);
+	EVBASE_RELEASE_LOCK(base);
+	return (0);
+}
+
+/* Service every priority per iteration, up to weights[pri] callbacks
+ * each; weights has one entry per priority.  NULL turns this off. */
+int
+event_base_set_priority_weights(struct event_base *base, const int *weights)
+{
+	int *copy = NULL;
+	int i;
+
+	if (weights != NULL) {
+		for (i = 0; i < base->nactivequeues; i++)
+			if (weights[i] < 1)
+				return (-1);
+		if ((copy = malloc(base->nactivequeues * sizeof(int))) == NULL)
+			return (-1);
+		memcpy(copy, weights, base->nactivequeues * sizeof(int));
+	}
+
+	EVBASE_ACQUIRE_LOCK(base);
+	free(base->priority_weights);
+	base->priority_weights = copy;
+	EVBASE_RELEASE_LOCK(base);
+	return (0);
 }
 
 
@@ -321,6 +1290,22 @@ event_loop(int flags)
 }
 
 
+/* Make the loop return after the current callback; any thread may ask
+ * once the base uses threads. */
+int
+event_base_loopbreak(struct event_base *base)
+{
+	if (base == NULL)
+		return (-1);
+
+	EVBASE_ACQUIRE_LOCK(base);
+	base->event_break = 1;
+	if (evthread_need_notify(base))
+		evthread_notify_base(base);
+	EVBASE_RELEASE_LOCK(base);
+	return (0);
+}
+
 int
 event_base_loop(struct event_base *base, int flags)
 {
@@ -328,13 +1313,15 @@ event_base_loop(struct event_base *base, int flags)
 	void *evbase = base->evbase;
 	struct timeval tv;
 	struct timeval *tv_p;
-	int res, done;
+	int res, done, retval = 0;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	base->th_owner_id = pthread_self();
+	base->running_loop = 1;
 
 	/* clear time cache */
 	base->tv_cache.tv_sec = 0;
 
-	if (base->sig.ev_signal_added)
-		evsignal_base = base;
 	done = 0;
 	while (!done) {
 		/* Terminate the loop if we have been asked to */
@@ -364,7 +1351,8 @@ event_base_loop(struct event_base *base, int flags)
 		/* If we have no events, we just exit */
 		if (!event_haveevents(base)) {
 			event_debug(("%s: no events registered.", __func__));
-			return (1);
+			retval = 1;
+			goto done;
 		}
 
 		/* update last old time */
@@ -373,10 +1361,31 @@ event_base_loop(struct event_base *base, int flags)
 		/* clear time cache */
 		base->tv_cache.tv_sec = 0;
 
-		res = evsel->dispatch(base, evbase, tv_p);
+		if (base->stats) {
+			struct event_base_stats *st = base->stats;
+			uint64_t t0, dt;
+
+			st->loops++;
+			st->timers = timeout_store_size(base);
+			if (st->timers > st->timers_max)
+				st->timers_max = st->timers;
+			t0 = event_stats_nsec();
+			res = evsel->dispatch(base, evbase, tv_p);
+			dt = event_stats_nsec() - t0;
+			/* a callback may have turned them off meanwhile */
+			if ((st = base->stats) != NULL) {
+				st->dispatches++;
+				st->nsec_blocked += dt;
+				st->hist_blocked[event_stats_bucket(dt)]++;
+			}
+		} else {
+			res = evsel->dispatch(base, evbase, tv_p);
+		}
 
-		if (res == -1)
-			return (-1);
+		if (res == -1) {
+			retval = -1;
+			goto done;
+		}
 		gettime(base, &base->tv_cache);
 
 		timeout_process(base);
@@ -389,11 +1398,14 @@ event_base_loop(struct event_base *base, int flags)
 			done = 1;
 	}
 
+	event_debug(("%s: asked to terminate loop.", __func__));
+done:
 	/* clear time cache */
 	base->tv_cache.tv_sec = 0;
 
-	event_debug(("%s: asked to terminate loop.", __func__));
-	return (0);
+	base->running_loop = 0;
+	EVBASE_RELEASE_LOCK(base);
+	return (retval);
 }
 
 
@@ -427,9 +1439,20 @@ event_queue_insert(struct event_base *base, struct event *ev, int queue)
 			base->event_count_active++;
 			TAILQ_INSERT_TAIL(base->activequeues[ev->ev_pri],
 					ev,ev_active_next);
+			base->activemap[ev->ev_pri / 64] |=
+				(uint64_t)1 << (ev->ev_pri % 64);
 			break;
 		case EVLIST_TIMEOUT: {
-								 min_heap_push(&base->timeheap, ev);
+								 if (ev->ev_flags & EVLIST_X_COMMON_TIMEOUT) {
+									 struct common_timeout_list *ctl =
+										 base->common_timeout_queues[ev->min_heap_idx];
+									 /* same duration, so the tail is the latest */
+									 TAILQ_INSERT_TAIL(&ctl->events, ev,
+											 ev_timeout_next);
+									 if (TAILQ_FIRST(&ctl->events) == ev)
+										 common_timeout_schedule(ctl, ev);
+								 } else
+									 timeout_store_push(base, ev);
 								 break;
 							 }
 		default:
@@ -444,15 +1467,38 @@ timeout_process(struct event_base *base)
 	struct timeval now;
 	struct event *ev;
 
-	if (min_heap_empty(&base->timeheap))
+	if (base->timeout_method == EVENT_TIMEOUT_WHEEL) {
+		if (!timewheel_size(base->timewheel))
+			return;
+		gettime(base, &now);
+		timewheel_advance(base->timewheel, &now);
+		while ((ev = timewheel_first_expired(base->timewheel))) {
+			if (ev->ev_callback == common_timeout_callback) {
+				common_timeout_process(ev->ev_arg, &now);
+				continue;
+			}
+			event_del(ev);
+			event_active(ev, EV_TIMEOUT, 1);
+		}
+		return;
+	}
+
+	if (timeout_store_top(base) == NULL)
 		return;
 
 	gettime(base, &now);
 
-	while ((ev = min_heap_top(&base->timeheap))) {
+	while ((ev = timeout_store_top(base))) {
 		if (evutil_timercmp(&ev->ev_timeout, &now, >))
 			break;
 
+		/* run a common timeout list without a trip through the
+		 * active queue */
+		if (ev->ev_callback == common_timeout_callback) {
+			common_timeout_process(ev->ev_arg, &now);
+			continue;
+		}
+
 		/* delete this event from the I/O queues */
 		event_del(ev);
 
@@ -485,9 +1531,24 @@ event_queue_remove(struct event_base *base, struct event *ev, int queue)
 			base->event_count_active--;
 			TAILQ_REMOVE(base->activequeues[ev->ev_pri],
 					ev, ev_active_next);
+			if (TAILQ_EMPTY(base->activequeues[ev->ev_pri]))
+				base->activemap[ev->ev_pri / 64] &=
+					~((uint64_t)1 << (ev->ev_pri % 64));
 			break;
 		case EVLIST_TIMEOUT:
-			min_heap_erase(&base->timeheap, ev);
+			if (ev->ev_flags & EVLIST_X_COMMON_TIMEOUT) {
+				struct common_timeout_list *ctl =
+					base->common_timeout_queues[ev->min_heap_idx];
+				int was_head = TAILQ_FIRST(&ctl->events) == ev;
+
+				TAILQ_REMOVE(&ctl->events, ev, ev_timeout_next);
+				ev->ev_flags &= ~EVLIST_X_COMMON_TIMEOUT;
+				ev->min_heap_idx = -1;
+				if (was_head)
+					common_timeout_schedule(ctl,
+							TAILQ_FIRST(&ctl->events));
+			} else
+				timeout_store_erase(base, ev);
 			break;
 		default:
 			event_errx(1, "%s: unknown queue %x", __func__, queue);
@@ -501,7 +1562,9 @@ timeout_correct(struct event_base *base, struct timeval *tv)
 	struct event **pev;
 	unsigned int size;
 	struct timeval off;
+	int i;
 
+	/* the timing wheel files events by tick and relies on this too */
 	if (use_monotonic)
 		return;
 
@@ -526,6 +1589,18 @@ timeout_correct(struct event_base *base, struct timeval *tv)
 		struct timeval *ev_tv = &(**pev).ev_timeout;
 		evutil_timersub(ev_tv, &off, ev_tv);
 	}
+	for (size = 0; size < base->timeheap4.n; ++size) {
+		min_heap4_entry_t *x = &base->timeheap4.p[size];
+		evutil_timersub(&x->e->ev_timeout, &off, &x->e->ev_timeout);
+		x->deadline = min_heap4_key(&x->e->ev_timeout);
+	}
+	for (i = 0; i < base->n_common_timeouts; ++i) {
+		struct event *ev;
+
+		TAILQ_FOREACH(ev, &base->common_timeout_queues[i]->events,
+				ev_timeout_next)
+			evutil_timersub(&ev->ev_timeout, &off, &ev->ev_timeout);
+	}
 	/* Now remember what the new time turned out to be. */
 	base->event_tv = *tv;
 }
@@ -533,6 +1608,18 @@ timeout_correct(struct event_base *base, struct timeval *tv)
 
 void
 event_active(struct event *ev, int res, short ncalls)
+{
+	struct event_base *base = ev->ev_base;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	event_active_nolock(ev, res, ncalls);
+	if (evthread_need_notify(base))
+		evthread_notify_base(base);
+	EVBASE_RELEASE_LOCK(base);
+}
+
+static void
+event_active_nolock(struct event *ev, int res, short ncalls)
 {
 	/* We get different kinds of events, add them together */
 	if (ev->ev_flags & EVLIST_ACTIVE) {
@@ -546,6 +1633,130 @@ event_active(struct event *ev, int res, short ncalls)
 	event_queue_insert(ev->ev_base, ev, EVLIST_ACTIVE);
 }
 
+static void
+event_io_done(int fd, short what, void *arg)
+{
+	struct event_io *io = arg;
+	struct event_base *base = io->ev.ev_base;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	base->n_pending_io--;
+	EVBASE_RELEASE_LOCK(base);
+
+	(*io->cb)(io->fd, io->res, io->cbarg);
+	free(io);
+}
+
+/* Readiness fallback: do the transfer once the fd is ready. */
+static void
+event_io_ready(int fd, short what, void *arg)
+{
+	struct event_io *io = arg;
+	ssize_t n;
+
+	if (io->write)
+		n = write(fd, io->buf, io->len);
+	else
+		n = read(fd, io->buf, io->len);
+	if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+		event_add(&io->ev, NULL);
+		return;
+	}
+	io->res = n == -1 ? -errno : n;
+	event_io_done(fd, what, io);
+}
+
+static int
+event_base_io(struct event_base *base, int fd, int iswrite, void *buf,
+    size_t len, event_io_cb cb, void *arg)
+{
+	const struct eventop *evsel = base->evsel;
+	struct event_io *io;
+	int res;
+
+	if ((io = calloc(1, sizeof(struct event_io))) == NULL)
+		return (-1);
+	io->fd = fd;
+	io->write = iswrite;
+	io->buf = buf;
+	io->len = len;
+	io->cb = cb;
+	io->cbarg = arg;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	if (evsel->submit_io != NULL) {
+		event_set(&io->ev, -1, 0, event_io_done, io);
+		event_base_set(base, &io->ev);
+		res = evsel->submit_io(base->evbase, io);
+	} else {
+		event_set(&io->ev, fd, iswrite ? EV_WRITE : EV_READ,
+		    event_io_ready, io);
+		event_base_set(base, &io->ev);
+		res = event_add_nolock(&io->ev, NULL);
+	}
+	if (res != -1) {
+		base->n_pending_io++;
+		if (evthread_need_notify(base))
+			evthread_notify_base(base);
+	}
+	EVBASE_RELEASE_LOCK(base);
+
+	if (res == -1)
+		free(io);
+	return (res);
+}
+
+int
+event_base_read(struct event_base *base, int fd, void *buf, size_t len,
+    event_io_cb cb, void *arg)
+{
+	return (event_base_io(base, fd, 0, buf, len, cb, arg));
+}
+
+int
+event_base_write(struct event_base *base, int fd, const void *buf,
+    size_t len, event_io_cb cb, void *arg)
+{
+	return (event_base_io(base, fd, 1, (void *)buf, len, cb, arg));
+}
+
+int
+event_base_register_buffers(struct event_base *base,
+    const struct iovec *iov, int n)
+{
+	int res = -1;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	if (base->evsel->register_buffers != NULL)
+		res = base->evsel->register_buffers(base->evbase, iov, n);
+	EVBASE_RELEASE_LOCK(base);
+	return (res);
+}
+
+int
+event_base_register_fd(struct event_base *base, int fd)
+{
+	int res = -1;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	if (base->evsel->register_fd != NULL)
+		res = base->evsel->register_fd(base->evbase, fd, 1);
+	EVBASE_RELEASE_LOCK(base);
+	return (res);
+}
+
+int
+event_base_unregister_fd(struct event_base *base, int fd)
+{
+	int res = -1;
+
+	EVBASE_ACQUIRE_LOCK(base);
+	if (base->evsel->register_fd != NULL)
+		res = base->evsel->register_fd(base->evbase, fd, 0);
+	EVBASE_RELEASE_LOCK(base);
+	return (res);
+}
+
 static int
 timeout_next(struct event_base *base, struct timeval **tv_p)
 {
@@ -553,7 +1764,15 @@ timeout_next(struct event_base *base, struct timeval **tv_p)
 	struct event *ev;
 	struct timeval *tv = *tv_p;
 
-	if ((ev = min_heap_top(&base->timeheap)) == NULL) {
+	if (base->timeout_method == EVENT_TIMEOUT_WHEEL) {
+		if (gettime(base, &now) == -1)
+			return (-1);
+		if (timewheel_next_timeout(base->timewheel, &now, tv))
+			*tv_p = NULL;
+		return (0);
+	}
+
+	if ((ev = timeout_store_top(base)) == NULL) {
 		/* if no time-based events are active wait for I/O */
 		*tv_p = NULL;
 		return (0);
@@ -576,7 +1795,42 @@ timeout_next(struct event_base *base, struct timeval **tv_p)
 	return (0);
 }
 
+/* (Re)arm the list's timer for the deadline of its new head. */
+static void
+common_timeout_schedule(struct common_timeout_list *ctl, struct event *head)
+{
+	struct event *tev = &ctl->timeout_event;
+
+	if (tev->ev_flags & EVLIST_TIMEOUT)
+		event_queue_remove(ctl->base, tev, EVLIST_TIMEOUT);
+	if (head == NULL)
+		return;
+	tev->ev_timeout = head->ev_timeout;
+	event_queue_insert(ctl->base, tev, EVLIST_TIMEOUT);
+}
 
+/* Activate every event at the front of the list whose deadline passed. */
+static void
+common_timeout_process(struct common_timeout_list *ctl,
+		const struct timeval *now)
+{
+	struct event *ev;
 
+	while ((ev = TAILQ_FIRST(&ctl->events)) != NULL) {
+		if (evutil_timercmp(&ev->ev_timeout, now, >))
+			break;
+		event_del(ev);
+		event_active(ev, EV_TIMEOUT, 1);
+	}
+	common_timeout_schedule(ctl, ev);
+}
 
+static void
+common_timeout_callback(int fd, short what, void *arg)
+{
+	struct common_timeout_list *ctl = arg;
+	struct timeval now;
 
+	gettime(ctl->base, &now);
+	common_timeout_process(ctl, &now);
+}
@@ -1,6 +1,7 @@
 #ifndef _EVENT_H_
 #define _EVENT_H_
 
+#include <stdint.h>
 #include <sys/types.h>
 
 #include "sys/queue.h"
@@ -31,10 +32,13 @@
 #define EV_WRITE    0x04
 #define EV_SIGNAL   0x08
 #define EV_PERSIST  0x10    /* Persistant event */
+#define EV_ET       0x20    /* Edge-triggered event */
+#define EV_EXCLUSIVE 0x40   /* Wake one of the bases sharing the fd (epoll) */
 
 
 
 struct event_base;
+struct iovec;
 
 
 
@@ -44,6 +48,7 @@ struct event {
     TAILQ_ENTRY (event) ev_next;
     TAILQ_ENTRY (event) ev_active_next;
     TAILQ_ENTRY (event) ev_signal_next;
+    TAILQ_ENTRY (event) ev_timeout_next; /* wheel slot or common timeout */
     unsigned int min_heap_idx;  /* for managing timeouts */
 
     struct event_base *ev_base;
@@ -80,9 +85,28 @@ TAILQ_HEAD (evkeyvalq, evkeyval);
 
 
 extern struct event_base *event_base_new(void);
+void event_base_free(struct event_base *);
 extern int  event_base_priority_init(struct event_base *, int);
+int event_priority_set(struct event *, int);
+int event_base_set_max_dispatch(struct event_base *, int,
+        const struct timeval *);
+int event_base_set_priority_weights(struct event_base *, const int *);
+const struct timeval *event_base_init_common_timeout(struct event_base *,
+        const struct timeval *);
 extern struct event_base *event_init(void);
+int event_base_set_timeout_method(struct event_base *, int);
+int event_base_use_threads(struct event_base *);
+int event_base_set(struct event_base *, struct event *);
+int event_base_loopbreak(struct event_base *);
+int event_base_set_clock(struct event_base *, int);
+int event_base_gettimeofday_cached(struct event_base *, struct timeval *);
+const char *event_base_get_method(struct event_base *);
+unsigned long event_base_get_backend_syscalls(struct event_base *);
 void event_set(struct event *, int, short, void (*)(int, short, void *), void *);
+struct event *event_new(struct event_base *, int, short,
+        void (*)(int, short, void *), void *);
+void event_free(struct event *);
+int event_base_prealloc_events(struct event_base *, int);
 int event_add(struct event *ev, const struct timeval *timeout);
 int event_del(struct event *);
 
@@ -92,6 +116,71 @@ int event_dispatch(void);
 int event_loop(int);
 int event_base_loop(struct event_base *, int);
 
+/**
+ * Completion-based I/O.  The loop performs the read or write itself and
+ * calls back with the byte count, or -errno on failure.  On io_uring the
+ * transfer and its notification take one kernel round trip; buffers and
+ * fds registered beforehand skip per-request page pinning and fd lookup.
+ * A registered fd must be unregistered before it is closed.
+ */
+typedef void (*event_io_cb)(int fd, ssize_t res, void *arg);
+int event_base_read(struct event_base *, int, void *, size_t,
+        event_io_cb, void *);
+int event_base_write(struct event_base *, int, const void *, size_t,
+        event_io_cb, void *);
+int event_base_register_buffers(struct event_base *, const struct iovec *,
+        int);
+int event_base_register_fd(struct event_base *, int);
+int event_base_unregister_fd(struct event_base *, int);
+
+
+/**
+ * Loop instrumentation, see event_base_enable_stats().  Histograms are
+ * log2-bucketed: bucket 0 counts zeros and bucket i > 0 counts values
+ * in [2^(i-1), 2^i); the last bucket also takes everything larger.
+ */
+#define EVENT_STATS_NBUCKETS	32
+
+struct event_base_stats {
+    unsigned long loops;            /* event_base_loop() iterations */
+    unsigned long dispatches;       /* backend waits, e.g. epoll_wait() */
+    unsigned long events_returned;  /* ready events those waits reported */
+    unsigned long callbacks;        /* event callbacks run */
+    uint64_t nsec_blocked;          /* time inside the backend wait */
+    uint64_t nsec_callbacks;        /* time inside callbacks */
+    unsigned timers;                /* timers pending at the last iteration */
+    unsigned timers_max;            /* most timers pending at once */
+
+    unsigned long hist_events[EVENT_STATS_NBUCKETS];     /* per wait */
+    unsigned long hist_blocked[EVENT_STATS_NBUCKETS];    /* ns per wait */
+    unsigned long hist_callback[EVENT_STATS_NBUCKETS];   /* ns per callback */
+};
+
+int event_base_enable_stats(struct event_base *, int);
+int event_base_get_stats(struct event_base *, struct event_base_stats *);
+void event_base_reset_stats(struct event_base *);
+
+
+/**
+ * Slow-callback detector, see event_base_set_slow_callback().  Totals
+ * are kept per callback function, so every event sharing a handler adds
+ * to the same entry.
+ */
+struct event_callback_total {
+    void (*callback)(int, short, void *);
+    unsigned long calls;
+    unsigned long slow;             /* calls at or over the threshold */
+    uint64_t nsec;                  /* total time in the callback */
+    uint64_t nsec_max;              /* longest single call */
+};
+
+typedef void (*event_slow_cb)(void (*callback)(int, short, void *),
+        int fd, short what, uint64_t nsec, void *arg);
+int event_base_set_slow_callback(struct event_base *, const struct timeval *,
+        event_slow_cb, void *);
+int event_base_get_callback_totals(struct event_base *,
+        struct event_callback_total *, int);
+
 
 /**
  *  event_loop() flags
@@ -101,6 +190,24 @@ int event_base_loop(struct event_base *, int);
 #define EVLOOP_NONBLOCK	0x02	/**< Do not block. */
 /*@}*/
 
+/**
+ *  event_base_set_clock() sources
+ *   */
+/*@{*/
+#define EVENT_CLOCK_MONOTONIC	0	/**< CLOCK_MONOTONIC, the default. */
+#define EVENT_CLOCK_COARSE	1	/**< CLOCK_MONOTONIC_COARSE, tick resolution. */
+#define EVENT_CLOCK_TSC		2	/**< Invariant TSC calibrated to CLOCK_MONOTONIC. */
+/*@}*/
+
+/**
+ *  event_base_set_timeout_method() methods
+ *   */
+/*@{*/
+#define EVENT_TIMEOUT_HEAP	0	/**< Binary min-heap, the default. */
+#define EVENT_TIMEOUT_WHEEL	1	/**< Hierarchical timing wheel, 1ms ticks. */
+#define EVENT_TIMEOUT_HEAP4	2	/**< 4-ary heap with inline deadline keys. */
+/*@}*/
+
 
 
 
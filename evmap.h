@@ -0,0 +1,89 @@
+#ifndef _EVMAP_H_
+#define _EVMAP_H_
+
+/*
+ * Per-fd bookkeeping shared by the readiness backends.  Any number of
+ * events may watch one fd; the backend asks the kernel for the union of
+ * their interest and fans each readiness report out to every event that
+ * wants it.  I/O events never sit on a signal list, so the per-fd list
+ * is linked through ev_signal_next.
+ */
+
+#include "event.h"
+
+struct evmap_io {
+    struct event_list events;
+    unsigned short nread;   /* events with EV_READ */
+    unsigned short nwrite;  /* events with EV_WRITE */
+    unsigned short net;     /* events with EV_ET */
+    unsigned short nexcl;   /* events with EV_EXCLUSIVE */
+    unsigned short nevents;
+};
+
+/* Edge triggering only when every event on the fd asked for it; a single
+ * level-triggered event would otherwise miss data left unread. */
+#define EVMAP_IO_ET(io)     ((io)->net != 0 && (io)->net == (io)->nevents)
+
+static inline void
+evmap_io_init(struct evmap_io *io)
+{
+    TAILQ_INIT(&io->events);
+    io->nread = io->nwrite = io->net = io->nexcl = io->nevents = 0;
+}
+
+/* Fix the list's self-references after the array holding io was moved. */
+static inline void
+evmap_io_relocate(struct evmap_io *io)
+{
+    struct event *first = TAILQ_FIRST(&io->events);
+
+    if (first == NULL)
+        TAILQ_INIT(&io->events);
+    else
+        first->ev_signal_next.tqe_prev = &TAILQ_FIRST(&io->events);
+}
+
+static inline void
+evmap_io_add(struct evmap_io *io, struct event *ev)
+{
+    TAILQ_INSERT_TAIL(&io->events, ev, ev_signal_next);
+    io->nevents++;
+    if (ev->ev_events & EV_READ)
+        io->nread++;
+    if (ev->ev_events & EV_WRITE)
+        io->nwrite++;
+    if (ev->ev_events & EV_ET)
+        io->net++;
+    if (ev->ev_events & EV_EXCLUSIVE)
+        io->nexcl++;
+}
+
+static inline void
+evmap_io_del(struct evmap_io *io, struct event *ev)
+{
+    TAILQ_REMOVE(&io->events, ev, ev_signal_next);
+    io->nevents--;
+    if (ev->ev_events & EV_READ)
+        io->nread--;
+    if (ev->ev_events & EV_WRITE)
+        io->nwrite--;
+    if (ev->ev_events & EV_ET)
+        io->net--;
+    if (ev->ev_events & EV_EXCLUSIVE)
+        io->nexcl--;
+}
+
+/* Activate every event on the fd that is interested in what. */
+static inline void
+evmap_io_active(struct evmap_io *io, short what)
+{
+    struct event *ev;
+    short res;
+
+    TAILQ_FOREACH(ev, &io->events, ev_signal_next) {
+        if ((res = ev->ev_events & what) != 0)
+            event_active(ev, res, 1);
+    }
+}
+
+#endif /* _EVMAP_H_ */
@@ -11,8 +11,17 @@ struct evsignal_info {
     volatile sig_atomic_t evsignal_caught;
     struct event_list evsigevents[NSIG];
     sig_atomic_t evsigcaught[NSIG];
-    struct sigaction **sh_old;
-    int sh_old_max;
+
+    /* slot in the handler's table of bases, -1 until a signal is added */
+    int slot;
+    volatile sig_atomic_t evsigwatched[NSIG];
+
+    /* EVENT_USE_SIGNALFD: signals this base owns are blocked and read
+     * from here, -1 otherwise */
+    struct event ev_sigfd;
+    int signalfd;
+    sigset_t sigfd_mask;        /* signals we own */
+    sigset_t sigfd_blocked;     /* signals we blocked ourselves */
 };
 
 
@@ -44,6 +44,8 @@ int evutil_make_socket_nonblocking(int sock);
 #define	evutil_timerclear(tvp)	(tvp)->tv_sec = (tvp)->tv_usec = 0
 #endif
 
+#define	evutil_timerisset(tvp)	((tvp)->tv_sec || (tvp)->tv_usec)
+
 #define EVUTIL_CLOSESOCKET(s) close(s)
 
 #define	evutil_timercmp(tvp, uvp, cmp)							\
@@ -0,0 +1,711 @@
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+
+#include "event.h"
+#include "event-internal.h"
+#include "evutil.h"
+#include "log.h"
+#include "evsignal.h"
+#include "evmap.h"
+
+#define MAX_IOURING_TIMEOUT_SEC (35*60)
+
+#define INITIAL_NFILES 32
+#define IOURING_ENTRIES 256
+/* size of the registered file table; a registered fd is its own slot */
+#define IOURING_MAX_FILES 4096
+
+/* user_data of requests whose completions carry no readiness */
+#define IOURING_UD_IGNORE   (~(uint64_t)0)
+/* user_data of an event_io request: its address with the top bit set */
+#define IOURING_UD_IO       ((uint64_t)1 << 63)
+
+#define IOURING_UD(fd, gen)     (((uint64_t)(fd) << 32) | (gen))
+#define IOURING_UD_FD(ud)       ((int)((ud) >> 32))
+#define IOURING_UD_GEN(ud)      ((uint32_t)(ud))
+
+
+/*
+ * One poll request per fd covers both directions.  Level-triggered
+ * events use one-shot polls that are re-armed on the next dispatch,
+ * which keeps epoll's semantics: if data is left unread, the re-armed
+ * poll completes at once.  EV_ET events use a multishot poll, which
+ * only completes on new wakeups and so matches edge triggering.
+ * Poll requests have no exclusive mode, so EV_EXCLUSIVE is ignored.
+ */
+struct evuring {
+    struct evmap_io io;     /* every event watching the fd */
+    unsigned armed;     /* poll mask of the request in flight, 0 if none */
+    int multishot;      /* the request in flight is multishot */
+    uint32_t gen;       /* generation of the request in flight */
+    int changed;        /* fd is queued on the changelist */
+    int fixed;          /* fd is in the registered file table */
+};
+
+struct uringop {
+    struct event_base *base;
+    int ringfd;
+    unsigned features;
+
+    /* submission queue */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned sq_pending;    /* SQEs filled but not yet submitted */
+    struct io_uring_sqe *sqes;
+
+    /* completion queue */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+
+    struct evuring *fds;
+    int nfds;
+
+    int *changes;
+    int nchanges;
+    int changes_size;
+
+    /* registered with event_base_register_buffers() */
+    struct iovec *bufs;
+    int nbufs;
+    int files_registered;
+};
+
+
+static void *iouring_init (struct event_base *);
+static int iouring_add    (void *, struct event *);
+static int iouring_del    (void *, struct event *);
+static int iouring_dispatch   (struct event_base *, void *, struct timeval *);
+static void iouring_dealloc   (struct event_base *, void *);
+static int iouring_submit_io    (void *, struct event_io *);
+static int iouring_register_buffers (void *, const struct iovec *, int);
+static int iouring_register_fd  (void *, int, int);
+
+const struct eventop iouringops = {
+    "io_uring",
+    iouring_init,
+    iouring_add,
+    iouring_del,
+    iouring_dispatch,
+    iouring_dealloc,
+    1, /* need reinit */
+    iouring_submit_io,
+    iouring_register_buffers,
+    iouring_register_fd
+};
+
+
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return ((int)syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+        unsigned flags, void *arg, size_t argsz)
+{
+    return ((int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                flags, arg, argsz));
+}
+
+
+static int
+sys_io_uring_register(int fd, unsigned opcode, const void *arg,
+        unsigned nr_args)
+{
+    return ((int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+
+static int
+iouring_recalc(struct uringop *uringop, int max)
+{
+    if (max >= uringop->nfds) {
+        struct evuring *fds;
+        int i, nfds;
+
+        nfds = uringop->nfds;
+        while (nfds <= max)
+            nfds <<= 1;
+
+        fds = realloc(uringop->fds, nfds * sizeof(struct evuring));
+        if (fds == NULL) {
+            event_warn("realloc");
+            return (-1);
+        }
+        uringop->fds = fds;
+        for (i = 0; i < uringop->nfds; i++)
+            evmap_io_relocate(&fds[i].io);
+        memset(fds + uringop->nfds, 0,
+                (nfds - uringop->nfds) * sizeof(struct evuring));
+        for (; i < nfds; i++)
+            evmap_io_init(&fds[i].io);
+        uringop->nfds = nfds;
+    }
+
+    return (0);
+}
+
+static int
+iouring_map(struct uringop *uringop, struct io_uring_params *p)
+{
+    int fd = uringop->ringfd;
+
+    uringop->sq_ring_sz = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    uringop->cq_ring_sz = p->cq_off.cqes +
+        p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (uringop->cq_ring_sz > uringop->sq_ring_sz)
+            uringop->sq_ring_sz = uringop->cq_ring_sz;
+        uringop->cq_ring_sz = uringop->sq_ring_sz;
+    }
+
+    uringop->sq_ring = mmap(NULL, uringop->sq_ring_sz,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQ_RING);
+    if (uringop->sq_ring == MAP_FAILED)
+        return (-1);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        uringop->cq_ring = uringop->sq_ring;
+    } else {
+        uringop->cq_ring = mmap(NULL, uringop->cq_ring_sz,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_CQ_RING);
+        if (uringop->cq_ring == MAP_FAILED)
+            return (-1);
+    }
+
+    uringop->sqes_sz = p->sq_entries * sizeof(struct io_uring_sqe);
+    uringop->sqes = mmap(NULL, uringop->sqes_sz,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQES);
+    if (uringop->sqes == MAP_FAILED)
+        return (-1);
+
+#define SQ_FIELD(f)  ((unsigned *)((char *)uringop->sq_ring + p->sq_off.f))
+#define CQ_FIELD(f)  ((unsigned *)((char *)uringop->cq_ring + p->cq_off.f))
+    uringop->sq_head = SQ_FIELD(head);
+    uringop->sq_tail = SQ_FIELD(tail);
+    uringop->sq_mask = SQ_FIELD(ring_mask);
+    uringop->sq_array = SQ_FIELD(array);
+    uringop->sq_entries = p->sq_entries;
+    uringop->cq_head = CQ_FIELD(head);
+    uringop->cq_tail = CQ_FIELD(tail);
+    uringop->cq_mask = CQ_FIELD(ring_mask);
+    uringop->cqes = (struct io_uring_cqe *)
+        ((char *)uringop->cq_ring + p->cq_off.cqes);
+#undef SQ_FIELD
+#undef CQ_FIELD
+
+    return (0);
+}
+
+static void
+iouring_unmap(struct uringop *uringop)
+{
+    if (uringop->sqes != NULL && uringop->sqes != MAP_FAILED)
+        munmap(uringop->sqes, uringop->sqes_sz);
+    if (uringop->cq_ring != NULL && uringop->cq_ring != MAP_FAILED &&
+            uringop->cq_ring != uringop->sq_ring)
+        munmap(uringop->cq_ring, uringop->cq_ring_sz);
+    if (uringop->sq_ring != NULL && uringop->sq_ring != MAP_FAILED)
+        munmap(uringop->sq_ring, uringop->sq_ring_sz);
+}
+
+static
+void *iouring_init (struct event_base *base)
+{
+    struct io_uring_params params;
+    struct uringop *uringop;
+    int i, fd;
+
+    /* Disable io_uring when this environment variable is set */
+    if (evutil_getenv("EVENT_NOIOURING"))
+        return (NULL);
+
+    memset(&params, 0, sizeof(params));
+    if ((fd = sys_io_uring_setup(IOURING_ENTRIES, &params)) == -1) {
+        if (errno != ENOSYS && errno != EPERM)
+            event_warn("io_uring_setup");
+        return (NULL);
+    }
+    /* we need the timeout argument to io_uring_enter */
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        return (NULL);
+    }
+
+    if (!(uringop = calloc(1, sizeof(struct uringop)))) {
+        close(fd);
+        return (NULL);
+    }
+    uringop->base = base;
+    uringop->ringfd = fd;
+    uringop->features = params.features;
+
+    if (iouring_map(uringop, &params) == -1) {
+        event_warn("mmap");
+        iouring_unmap(uringop);
+        close(fd);
+        free(uringop);
+        return (NULL);
+    }
+
+    uringop->fds = calloc(INITIAL_NFILES, sizeof(struct evuring));
+    if (uringop->fds == NULL) {
+        iouring_unmap(uringop);
+        close(fd);
+        free(uringop);
+        return (NULL);
+    }
+    uringop->nfds = INITIAL_NFILES;
+    for (i = 0; i < INITIAL_NFILES; i++)
+        evmap_io_init(&uringop->fds[i].io);
+
+    evsignal_init(base);
+    return (uringop);
+}
+
+/* Hand every filled SQE to the kernel without waiting for anything. */
+static int
+iouring_submit(struct uringop *uringop)
+{
+    int res;
+
+    while (uringop->sq_pending) {
+        res = sys_io_uring_enter(uringop->ringfd, uringop->sq_pending,
+                0, 0, NULL, 0);
+        uringop->base->backend_syscalls++;
+        if (res == -1) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        uringop->sq_pending -= res;
+    }
+    return (0);
+}
+
+static struct io_uring_sqe *
+iouring_get_sqe(struct uringop *uringop)
+{
+    unsigned tail = *uringop->sq_tail;
+    unsigned head = __atomic_load_n(uringop->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    if (tail - head == uringop->sq_entries) {
+        /* ring full: flush what we have first */
+        if (iouring_submit(uringop) == -1)
+            return (NULL);
+        head = __atomic_load_n(uringop->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head == uringop->sq_entries)
+            return (NULL);
+    }
+
+    idx = tail & *uringop->sq_mask;
+    sqe = &uringop->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    uringop->sq_array[idx] = idx;
+    return (sqe);
+}
+
+/* Publish the SQE iouring_get_sqe() returned once the caller filled it. */
+static void
+iouring_commit_sqe(struct uringop *uringop)
+{
+    __atomic_store_n(uringop->sq_tail, *uringop->sq_tail + 1,
+            __ATOMIC_RELEASE);
+    uringop->sq_pending++;
+}
+
+static unsigned
+iouring_wanted(struct evuring *evu, int *multishot)
+{
+    unsigned mask = 0;
+
+    if (evu->io.nread)
+        mask |= POLLIN;
+    if (evu->io.nwrite)
+        mask |= POLLOUT;
+    *multishot = mask && EVMAP_IO_ET(&evu->io);
+    return (mask);
+}
+
+/* Queue the SQEs that bring fd's poll request in line with its events. */
+static int
+iouring_apply(struct uringop *uringop, int fd)
+{
+    struct evuring *evu = &uringop->fds[fd];
+    struct io_uring_sqe *sqe;
+    unsigned mask;
+    int multishot;
+
+    mask = iouring_wanted(evu, &multishot);
+    if (mask == evu->armed && multishot == evu->multishot)
+        return (0);
+
+    if (evu->armed) {
+        if ((sqe = iouring_get_sqe(uringop)) == NULL)
+            return (-1);
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = IOURING_UD(fd, evu->gen);
+        sqe->user_data = IOURING_UD_IGNORE;
+        iouring_commit_sqe(uringop);
+        evu->armed = 0;
+    }
+    /* completions of the old request are stale from here on */
+    evu->gen++;
+
+    if (mask) {
+        if ((sqe = iouring_get_sqe(uringop)) == NULL)
+            return (-1);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = mask;
+        if (multishot)
+            sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = IOURING_UD(fd, evu->gen);
+        iouring_commit_sqe(uringop);
+        evu->armed = mask;
+        evu->multishot = multishot;
+    }
+    return (0);
+}
+
+static int
+iouring_queue_change(struct uringop *uringop, int fd)
+{
+    struct evuring *evu = &uringop->fds[fd];
+
+    if (evu->changed)
+        return (0);
+
+    if (uringop->nchanges == uringop->changes_size) {
+        int new_size = uringop->changes_size ? uringop->changes_size * 2 :
+            INITIAL_NFILES;
+        int *changes = realloc(uringop->changes, new_size * sizeof(int));
+        if (changes == NULL) {
+            event_warn("realloc");
+            return (-1);
+        }
+        uringop->changes = changes;
+        uringop->changes_size = new_size;
+    }
+    uringop->changes[uringop->nchanges++] = fd;
+    evu->changed = 1;
+    return (0);
+}
+
+static int
+iouring_add    (void *arg, struct event *ev)
+{
+    struct uringop *uringop = arg;
+    struct evuring *evu;
+    int fd;
+
+    if (ev->ev_events & EV_SIGNAL)
+        return (evsignal_add(ev));
+
+    fd = ev->ev_fd;
+    if (fd >= uringop->nfds) {
+        if (iouring_recalc(uringop, fd) == -1)
+            return (-1);
+    }
+    evu = &uringop->fds[fd];
+
+    if (iouring_queue_change(uringop, fd) == -1)
+        return (-1);
+    evmap_io_add(&evu->io, ev);
+    return (0);
+}
+
+static int
+iouring_del    (void *arg, struct event *ev)
+{
+    struct uringop *uringop = arg;
+    struct evuring *evu;
+    int fd;
+
+    if (ev->ev_events & EV_SIGNAL)
+        return (evsignal_del(ev));
+
+    fd = ev->ev_fd;
+    if (fd >= uringop->nfds)
+        return (0);
+    evu = &uringop->fds[fd];
+
+    evmap_io_del(&evu->io, ev);
+    return (iouring_queue_change(uringop, fd));
+}
+
+static void
+iouring_complete(struct uringop *uringop, struct io_uring_cqe *cqe)
+{
+    struct evuring *evu;
+    short res = 0;
+    int fd, what;
+
+    if (cqe->user_data == IOURING_UD_IGNORE)
+        return;
+    if (cqe->user_data & IOURING_UD_IO) {
+        struct event_io *io = (struct event_io *)(uintptr_t)
+            (cqe->user_data & ~IOURING_UD_IO);
+        io->res = cqe->res;
+        event_active(&io->ev, io->write ? EV_WRITE : EV_READ, 1);
+        return;
+    }
+    fd = IOURING_UD_FD(cqe->user_data);
+    if (fd < 0 || fd >= uringop->nfds)
+        return;
+    evu = &uringop->fds[fd];
+    if (IOURING_UD_GEN(cqe->user_data) != evu->gen)
+        return;
+
+    /* a one-shot poll, or a multishot one the kernel ended, is spent */
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        evu->armed = 0;
+        iouring_queue_change(uringop, fd);
+    }
+    if (cqe->res < 0)
+        return;
+
+    what = cqe->res;
+    if (what & (POLLHUP|POLLERR|POLLNVAL)) {
+        res = EV_READ | EV_WRITE;
+    } else {
+        if (what & POLLIN)
+            res |= EV_READ;
+        if (what & POLLOUT)
+            res |= EV_WRITE;
+    }
+
+    if (res)
+        evmap_io_active(&evu->io, res);
+}
+
+static int
+iouring_submit_io    (void *arg, struct event_io *io)
+{
+    struct uringop *uringop = arg;
+    struct io_uring_sqe *sqe;
+    int i;
+
+    /* the SQE length is 32 bits; don't silently truncate */
+    if (io->len > UINT32_MAX) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if ((sqe = iouring_get_sqe(uringop)) == NULL)
+        return (-1);
+    sqe->opcode = io->write ? IORING_OP_WRITE : IORING_OP_READ;
+    for (i = 0; i < uringop->nbufs; i++) {
+        char *base = uringop->bufs[i].iov_base;
+        if ((char *)io->buf >= base && (char *)io->buf + io->len <=
+                base + uringop->bufs[i].iov_len) {
+            sqe->opcode = io->write ? IORING_OP_WRITE_FIXED :
+                IORING_OP_READ_FIXED;
+            sqe->buf_index = i;
+            break;
+        }
+    }
+    sqe->fd = io->fd;
+    if (io->fd < uringop->nfds && uringop->fds[io->fd].fixed)
+        sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)io->buf;
+    sqe->len = io->len;
+    sqe->off = (uint64_t)-1;    /* current position; ignored by sockets */
+    sqe->user_data = (uint64_t)(uintptr_t)io | IOURING_UD_IO;
+    iouring_commit_sqe(uringop);
+    return (0);
+}
+
+static int
+iouring_register_buffers (void *arg, const struct iovec *iov, int n)
+{
+    struct uringop *uringop = arg;
+    struct iovec *bufs = NULL;
+
+    if (n > 0 && (bufs = malloc(n * sizeof(struct iovec))) == NULL)
+        return (-1);
+
+    if (uringop->nbufs) {
+        uringop->base->backend_syscalls++;
+        sys_io_uring_register(uringop->ringfd, IORING_UNREGISTER_BUFFERS,
+                NULL, 0);
+        free(uringop->bufs);
+        uringop->bufs = NULL;
+        uringop->nbufs = 0;
+    }
+    if (n <= 0)
+        return (0);
+
+    uringop->base->backend_syscalls++;
+    if (sys_io_uring_register(uringop->ringfd, IORING_REGISTER_BUFFERS,
+                iov, n) == -1) {
+        event_warn("io_uring_register: buffers");
+        free(bufs);
+        return (-1);
+    }
+    memcpy(bufs, iov, n * sizeof(struct iovec));
+    uringop->bufs = bufs;
+    uringop->nbufs = n;
+    return (0);
+}
+
+static int
+iouring_register_fd  (void *arg, int fd, int on)
+{
+    struct uringop *uringop = arg;
+    struct io_uring_files_update up;
+    int slot = on ? fd : -1;
+
+    if (fd < 0 || fd >= IOURING_MAX_FILES)
+        return (-1);
+    if (fd >= uringop->nfds) {
+        if (!on || iouring_recalc(uringop, fd) == -1)
+            return (-1);
+    }
+    if (uringop->fds[fd].fixed == on)
+        return (0);
+
+    if (!uringop->files_registered) {
+        int *files, i, res;
+
+        /* an empty table, filled in one slot at a time */
+        if ((files = malloc(IOURING_MAX_FILES * sizeof(int))) == NULL)
+            return (-1);
+        for (i = 0; i < IOURING_MAX_FILES; i++)
+            files[i] = -1;
+        uringop->base->backend_syscalls++;
+        res = sys_io_uring_register(uringop->ringfd, IORING_REGISTER_FILES,
+                files, IOURING_MAX_FILES);
+        free(files);
+        if (res == -1) {
+            event_warn("io_uring_register: files");
+            return (-1);
+        }
+        uringop->files_registered = 1;
+    }
+
+    memset(&up, 0, sizeof(up));
+    up.offset = fd;
+    up.fds = (uint64_t)(uintptr_t)&slot;
+    uringop->base->backend_syscalls++;
+    if (sys_io_uring_register(uringop->ringfd, IORING_REGISTER_FILES_UPDATE,
+                &up, 1) == -1) {
+        event_warn("io_uring_register: fd %d", fd);
+        return (-1);
+    }
+    uringop->fds[fd].fixed = on;
+    return (0);
+}
+
+static int
+iouring_dispatch   (struct event_base *base, void *arg, struct timeval *tv)
+{
+    struct uringop *uringop = arg;
+    struct io_uring_getevents_arg garg;
+    struct __kernel_timespec ts;
+    unsigned head, tail, flags = 0, min_complete = 0, to_submit;
+    int i, res, n = 0;
+
+    /* turn the changelist into SQEs, submitted with the wait below */
+    for (i = 0; i < uringop->nchanges; i++) {
+        int fd = uringop->changes[i];
+        uringop->fds[fd].changed = 0;
+        if (iouring_apply(uringop, fd) == -1)
+            event_warn("%s: cannot queue poll for fd %d", __func__, fd);
+    }
+    uringop->nchanges = 0;
+
+    head = *uringop->cq_head;
+    tail = __atomic_load_n(uringop->cq_tail, __ATOMIC_ACQUIRE);
+
+    /* only wait if nothing has completed already */
+    if (head == tail && (tv == NULL || tv->tv_sec || tv->tv_usec)) {
+        flags = IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+        if (tv != NULL) {
+            memset(&garg, 0, sizeof(garg));
+            ts.tv_sec = tv->tv_sec;
+            if (ts.tv_sec > MAX_IOURING_TIMEOUT_SEC)
+                ts.tv_sec = MAX_IOURING_TIMEOUT_SEC;
+            ts.tv_nsec = tv->tv_usec * 1000;
+            garg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+
+    if (flags || uringop->sq_pending) {
+        /* sq_pending is only stable while we hold the lock */
+        to_submit = uringop->sq_pending;
+        /* let other threads add and delete events while we sleep */
+        EVBASE_RELEASE_LOCK(base);
+        res = sys_io_uring_enter(uringop->ringfd, to_submit,
+                min_complete, flags, (flags & IORING_ENTER_EXT_ARG) ?
+                (void *)&garg : NULL,
+                (flags & IORING_ENTER_EXT_ARG) ? sizeof(garg) : 0);
+        EVBASE_ACQUIRE_LOCK(base);
+        base->backend_syscalls++;
+
+        if (res >= 0) {
+            uringop->sq_pending -= res < (int)to_submit ? res : to_submit;
+        } else if (errno == EINTR) {
+            evsignal_process(base);
+        } else if (errno != ETIME && errno != EBUSY) {
+            event_warn("io_uring_enter");
+            return (-1);
+        }
+    }
+    if (base->sig.evsignal_caught)
+        evsignal_process(base);
+
+    head = *uringop->cq_head;
+    tail = __atomic_load_n(uringop->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++, n++)
+        iouring_complete(uringop,
+                &uringop->cqes[head & *uringop->cq_mask]);
+    __atomic_store_n(uringop->cq_head, head, __ATOMIC_RELEASE);
+
+    event_debug(("%s: io_uring reports %d", __func__, n));
+    EVENT_STATS_EVENTS(base, n);
+    return (0);
+}
+
+static void
+iouring_dealloc   (struct event_base *base, void *arg)
+{
+    struct uringop *uringop = arg;
+
+    evsignal_dealloc(base);
+    if (uringop->fds)
+        free(uringop->fds);
+    if (uringop->changes)
+        free(uringop->changes);
+    if (uringop->bufs)
+        free(uringop->bufs);
+    iouring_unmap(uringop);
+    if (uringop->ringfd >= 0)
+        close(uringop->ringfd);
+
+    memset(uringop, 0, sizeof(struct uringop));
+    free(uringop);
+}
@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "event.h"
+#include "evutil.h"
+#include "log.h"
+#include "listener.h"
+
+#define LISTENER_DEFAULT_BUDGET	16
+
+struct evconnlistener {
+	struct event_base *base;
+	struct event ev_accept;
+	struct event ev_resume;		/* ends a pause after EMFILE */
+	evconnlistener_cb cb;
+	void *arg;
+	int fd;
+	int budget;
+	struct timeval pause;
+	int enabled;
+	int paused;
+};
+
+
+/* Out of descriptors: the socket stays readable, so stop watching it for
+ * a while instead of waking up for every pass through the loop. */
+static void
+listener_pause(struct evconnlistener *lev)
+{
+	event_warn("%s: accept on fd %d, pausing for %ld ms", __func__,
+	    lev->fd, lev->pause.tv_sec * 1000 + lev->pause.tv_usec / 1000);
+	event_del(&lev->ev_accept);
+	lev->paused = 1;
+	evtimer_add(&lev->ev_resume, &lev->pause);
+}
+
+static void
+listener_resume(int fd, short what, void *arg)
+{
+	struct evconnlistener *lev = arg;
+
+	lev->paused = 0;
+	if (lev->enabled)
+		event_add(&lev->ev_accept, NULL);
+}
+
+static void
+listener_accept(int fd, short what, void *arg)
+{
+	struct evconnlistener *lev = arg;
+	struct sockaddr_storage ss;
+	socklen_t sslen;
+	int i, nfd;
+
+	for (i = 0; i < lev->budget && lev->enabled; i++) {
+		sslen = sizeof(ss);
+		nfd = accept4(fd, (struct sockaddr *)&ss, &sslen,
+		    SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (nfd != -1) {
+			(*lev->cb)(lev, nfd, (struct sockaddr *)&ss, sslen,
+			    lev->arg);
+			continue;
+		}
+
+		switch (errno) {
+		case EINTR:
+		case ECONNABORTED:
+			/* this one is gone, there may be more */
+			continue;
+		case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+		case EWOULDBLOCK:
+#endif
+			return;
+		case EMFILE:
+		case ENFILE:
+		case ENOBUFS:
+		case ENOMEM:
+			listener_pause(lev);
+			return;
+		default:
+			event_warn("%s: accept on fd %d", __func__, fd);
+			return;
+		}
+	}
+	/* budget spent: the event is level-triggered, so whatever is left
+	 * gets accepted on the next pass through the loop */
+}
+
+struct evconnlistener *
+evconnlistener_new(struct event_base *base, evconnlistener_cb cb, void *arg,
+    int flags, int fd)
+{
+	struct evconnlistener *lev;
+	short events = EV_READ | EV_PERSIST;
+
+	if (evutil_make_socket_nonblocking(fd) == -1)
+		return (NULL);
+	if ((lev = calloc(1, sizeof(struct evconnlistener))) == NULL)
+		return (NULL);
+	lev->base = base;
+	lev->cb = cb;
+	lev->arg = arg;
+	lev->fd = fd;
+	lev->budget = LISTENER_DEFAULT_BUDGET;
+	lev->pause.tv_sec = 1;
+
+	if (flags & EVCONNLISTENER_EXCLUSIVE)
+		events |= EV_EXCLUSIVE;
+	event_set(&lev->ev_accept, fd, events, listener_accept, lev);
+	event_base_set(base, &lev->ev_accept);
+	evtimer_set(&lev->ev_resume, listener_resume, lev);
+	event_base_set(base, &lev->ev_resume);
+
+	if (evconnlistener_enable(lev) == -1) {
+		free(lev);
+		return (NULL);
+	}
+	return (lev);
+}
+
+struct evconnlistener *
+evconnlistener_new_bind(struct event_base *base, evconnlistener_cb cb,
+    void *arg, int flags, int backlog, const struct sockaddr *sa,
+    socklen_t salen)
+{
+	struct evconnlistener *lev;
+	int fd, on = 1;
+
+	fd = socket(sa->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	    0);
+	if (fd == -1) {
+		event_warn("%s: socket", __func__);
+		return (NULL);
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+	    ((flags & EVCONNLISTENER_REUSEPORT) &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) ||
+	    bind(fd, sa, salen) == -1 ||
+	    listen(fd, backlog > 0 ? backlog : 128) == -1) {
+		event_warn("%s: listener setup", __func__);
+		close(fd);
+		return (NULL);
+	}
+	if ((lev = evconnlistener_new(base, cb, arg, flags, fd)) == NULL)
+		close(fd);
+	return (lev);
+}
+
+void
+evconnlistener_free(struct evconnlistener *lev)
+{
+	event_del(&lev->ev_accept);
+	event_del(&lev->ev_resume);
+	close(lev->fd);
+	free(lev);
+}
+
+int
+evconnlistener_enable(struct evconnlistener *lev)
+{
+	lev->enabled = 1;
+	/* a pending pause re-adds the event when it ends */
+	if (lev->paused)
+		return (0);
+	return (event_add(&lev->ev_accept, NULL));
+}
+
+int
+evconnlistener_disable(struct evconnlistener *lev)
+{
+	lev->enabled = 0;
+	return (event_del(&lev->ev_accept));
+}
+
+int
+evconnlistener_set_budget(struct evconnlistener *lev, int naccepts)
+{
+	if (naccepts < 1)
+		return (-1);
+	lev->budget = naccepts;
+	return (0);
+}
+
+void
+evconnlistener_set_pause(struct evconnlistener *lev, const struct timeval *tv)
+{
+	lev->pause = *tv;
+}
+
+int
+evconnlistener_get_fd(struct evconnlistener *lev)
+{
+	return (lev->fd);
+}
+
+struct event_base *
+evconnlistener_get_base(struct evconnlistener *lev)
+{
+	return (lev->base);
+}
@@ -0,0 +1,49 @@
+#ifndef _LISTENER_H_
+#define _LISTENER_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+struct event_base;
+struct timeval;
+
+/*
+ * A listening socket watched by a base.  Each wakeup accepts up to a
+ * budget of connections with accept4(), so they arrive non-blocking and
+ * close-on-exec without an fcntl() each, and a connection storm cannot
+ * keep the rest of the loop waiting.  When the process runs out of
+ * descriptors the listener stops watching the socket and retries after
+ * a pause, rather than spinning on a socket that stays readable.
+ */
+struct evconnlistener;
+
+/* Called with each new non-blocking fd; the callback owns it.  It may
+ * disable the listener but must not free it. */
+typedef void (*evconnlistener_cb)(struct evconnlistener *, int,
+    struct sockaddr *, socklen_t, void *);
+
+#define EVCONNLISTENER_REUSEPORT	0x01	/* SO_REUSEPORT on the socket */
+#define EVCONNLISTENER_EXCLUSIVE	0x02	/* watch it with EV_EXCLUSIVE */
+
+/* Takes over fd, a socket already listening; it is made non-blocking. */
+struct evconnlistener *evconnlistener_new(struct event_base *,
+    evconnlistener_cb, void *, int flags, int fd);
+struct evconnlistener *evconnlistener_new_bind(struct event_base *,
+    evconnlistener_cb, void *, int flags, int backlog,
+    const struct sockaddr *, socklen_t);
+/* Closes the listening socket. */
+void evconnlistener_free(struct evconnlistener *);
+
+int evconnlistener_enable(struct evconnlistener *);
+int evconnlistener_disable(struct evconnlistener *);
+
+/* Connections accepted per wakeup; 16 by default. */
+int evconnlistener_set_budget(struct evconnlistener *, int);
+/* How long to stop accepting after EMFILE or ENFILE; 1 s by default. */
+void evconnlistener_set_pause(struct evconnlistener *,
+    const struct timeval *);
+
+int evconnlistener_get_fd(struct evconnlistener *);
+struct event_base *evconnlistener_get_base(struct evconnlistener *);
+
+#endif /* _LISTENER_H_ */
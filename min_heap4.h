@@ -0,0 +1,153 @@
+#ifndef _MIN_HEAP4_H_
+#define _MIN_HEAP4_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event.h"
+#include "evutil.h"
+
+/*
+ * 4-ary min-heap keyed on a 64-bit nanosecond deadline stored next to the
+ * event pointer, so comparisons never touch the event itself.  The array
+ * is offset so that the four children of a node share one 64-byte line.
+ */
+typedef struct min_heap4_entry
+{
+	uint64_t deadline;
+	struct event* e;
+} min_heap4_entry_t;
+
+typedef struct min_heap4
+{
+	min_heap4_entry_t* p;
+	void* mem;
+	unsigned n, a;
+} min_heap4_t;
+
+#define MIN_HEAP4_LINE	64
+#define MIN_HEAP4_PAD	(MIN_HEAP4_LINE / sizeof(min_heap4_entry_t) - 1)
+
+static inline void           min_heap4_ctor(min_heap4_t* s);
+static inline void           min_heap4_dtor(min_heap4_t* s);
+static inline uint64_t       min_heap4_key(const struct timeval* tv);
+static inline int            min_heap4_empty(min_heap4_t* s);
+static inline unsigned       min_heap4_size(min_heap4_t* s);
+static inline struct event*  min_heap4_top(min_heap4_t* s);
+static inline int            min_heap4_reserve(min_heap4_t* s, unsigned n);
+static inline int            min_heap4_push(min_heap4_t* s, struct event* e);
+static inline struct event*  min_heap4_pop(min_heap4_t* s);
+static inline int            min_heap4_erase(min_heap4_t* s, struct event* e);
+static inline void           min_heap4_shift_up_(min_heap4_t* s, unsigned hole_index, min_heap4_entry_t x);
+static inline void           min_heap4_shift_down_(min_heap4_t* s, unsigned hole_index, min_heap4_entry_t x);
+
+uint64_t min_heap4_key(const struct timeval* tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000000u + (uint64_t)tv->tv_usec * 1000u;
+}
+
+void min_heap4_ctor(min_heap4_t* s) { s->p = 0; s->mem = 0; s->n = 0; s->a = 0; }
+void min_heap4_dtor(min_heap4_t* s) { free(s->mem); }
+int min_heap4_empty(min_heap4_t* s) { return 0u == s->n; }
+unsigned min_heap4_size(min_heap4_t* s) { return s->n; }
+struct event* min_heap4_top(min_heap4_t* s) { return s->n ? s->p->e : 0; }
+
+int min_heap4_push(min_heap4_t* s, struct event* e)
+{
+	min_heap4_entry_t x;
+	if(min_heap4_reserve(s, s->n + 1))
+		return -1;
+	x.deadline = min_heap4_key(&e->ev_timeout);
+	x.e = e;
+	min_heap4_shift_up_(s, s->n++, x);
+	return 0;
+}
+
+struct event* min_heap4_pop(min_heap4_t* s)
+{
+	if(s->n)
+	{
+		struct event* e = s->p->e;
+		if(--s->n)
+			min_heap4_shift_down_(s, 0u, s->p[s->n]);
+		e->min_heap_idx = -1;
+		return e;
+	}
+	return 0;
+}
+
+int min_heap4_erase(min_heap4_t* s, struct event* e)
+{
+	if(((unsigned int)-1) != e->min_heap_idx)
+	{
+		unsigned idx = e->min_heap_idx;
+		min_heap4_entry_t last = s->p[--s->n];
+		if (idx != s->n)
+		{
+			if (idx > 0 && s->p[(idx - 1) / 4].deadline > last.deadline)
+				min_heap4_shift_up_(s, idx, last);
+			else
+				min_heap4_shift_down_(s, idx, last);
+		}
+		e->min_heap_idx = -1;
+		return 0;
+	}
+	return -1;
+}
+
+int min_heap4_reserve(min_heap4_t* s, unsigned n)
+{
+	if(s->a < n)
+	{
+		void* mem;
+		unsigned a = s->a ? s->a * 2 : 8;
+		if(a < n)
+			a = n;
+		/* aligned storage cannot be realloc()ed; copy it over */
+		if(posix_memalign(&mem, MIN_HEAP4_LINE, (a + MIN_HEAP4_PAD) * sizeof(min_heap4_entry_t)))
+			return -1;
+		if(s->n)
+			memcpy((min_heap4_entry_t*)mem + MIN_HEAP4_PAD, s->p, s->n * sizeof(min_heap4_entry_t));
+		free(s->mem);
+		s->mem = mem;
+		s->p = (min_heap4_entry_t*)mem + MIN_HEAP4_PAD;
+		s->a = a;
+	}
+	return 0;
+}
+
+void min_heap4_shift_up_(min_heap4_t* s, unsigned hole_index, min_heap4_entry_t x)
+{
+	unsigned parent = (hole_index - 1) / 4;
+	while(hole_index && s->p[parent].deadline > x.deadline)
+	{
+		(s->p[hole_index] = s->p[parent]).e->min_heap_idx = hole_index;
+		hole_index = parent;
+		parent = (hole_index - 1) / 4;
+	}
+	(s->p[hole_index] = x).e->min_heap_idx = hole_index;
+}
+
+void min_heap4_shift_down_(min_heap4_t* s, unsigned hole_index, min_heap4_entry_t x)
+{
+	unsigned child, last, min_child, i;
+	for(;;)
+	{
+		child = 4 * hole_index + 1;
+		if(child >= s->n)
+			break;
+		last = child + 4 < s->n ? child + 4 : s->n;
+		min_child = child;
+		for(i = child + 1; i < last; i++)
+			if(s->p[i].deadline < s->p[min_child].deadline)
+				min_child = i;
+		if(!(x.deadline > s->p[min_child].deadline))
+			break;
+		(s->p[hole_index] = s->p[min_child]).e->min_heap_idx = hole_index;
+		hole_index = min_child;
+	}
+	(s->p[hole_index] = x).e->min_heap_idx = hole_index;
+}
+
+#endif /* _MIN_HEAP4_H_ */
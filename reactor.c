@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#include "event.h"
+#include "evutil.h"
+#include "log.h"
+#include "listener.h"
+#include "reactor.h"
+
+struct reactor {
+	struct reactor_pool *pool;
+	struct event_base *base;
+	pthread_t thread;
+	int cpu;
+	struct evconnlistener *listener;
+};
+
+struct reactor_pool {
+	struct reactor *reactors;
+	int nreactors;
+	int running;
+	reactor_accept_cb cb;
+	void *arg;
+};
+
+
+static void
+reactor_accept(struct evconnlistener *lev, int fd, struct sockaddr *sa,
+    socklen_t salen, void *arg)
+{
+	struct reactor *r = arg;
+
+	(*r->pool->cb)(r->base, fd, r->pool->arg);
+}
+
+static void *
+reactor_thread(void *arg)
+{
+	struct reactor *r = arg;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(r->cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		event_warn("%s: cannot pin to cpu %d", __func__, r->cpu);
+
+	event_base_loop(r->base, 0);
+	return (NULL);
+}
+
+struct reactor_pool *
+reactor_pool_new(int nreactors, const struct sockaddr *sa, socklen_t salen,
+    reactor_accept_cb cb, void *arg)
+{
+	struct reactor_pool *pool;
+	struct reactor *r;
+	long ncpus;
+	int i;
+
+	if (nreactors < 1)
+		return (NULL);
+	if ((pool = calloc(1, sizeof(struct reactor_pool))) == NULL)
+		return (NULL);
+	if ((pool->reactors = calloc(nreactors, sizeof(struct reactor))) == NULL) {
+		free(pool);
+		return (NULL);
+	}
+	pool->cb = cb;
+	pool->arg = arg;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		ncpus = 1;
+
+	for (i = 0; i < nreactors; i++) {
+		r = &pool->reactors[i];
+		r->pool = pool;
+		r->cpu = i % ncpus;
+		/* event_base_new() leaves current_base alone */
+		r->base = event_base_new();
+		if (event_base_use_threads(r->base) == -1 ||
+		    (r->listener = evconnlistener_new_bind(r->base,
+		    reactor_accept, r, EVCONNLISTENER_REUSEPORT, 1024,
+		    sa, salen)) == NULL) {
+			event_base_free(r->base);
+			goto fail;
+		}
+		pool->nreactors++;
+	}
+	return (pool);
+
+fail:
+	reactor_pool_free(pool);
+	return (NULL);
+}
+
+int
+reactor_pool_start(struct reactor_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < pool->nreactors; i++) {
+		if (pthread_create(&pool->reactors[i].thread, NULL,
+		    reactor_thread, &pool->reactors[i]) != 0) {
+			event_warn("%s: pthread_create", __func__);
+			pool->running = i;
+			reactor_pool_stop(pool);
+			return (-1);
+		}
+	}
+	pool->running = pool->nreactors;
+	return (0);
+}
+
+void
+reactor_pool_stop(struct reactor_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < pool->running; i++)
+		event_base_loopbreak(pool->reactors[i].base);
+	for (i = 0; i < pool->running; i++)
+		pthread_join(pool->reactors[i].thread, NULL);
+	pool->running = 0;
+}
+
+/* Stops the pool, closes the listeners and frees the bases; events the
+ * accept callback put on them must be gone by now. */
+void
+reactor_pool_free(struct reactor_pool *pool)
+{
+	struct reactor *r;
+	int i;
+
+	if (pool->running)
+		reactor_pool_stop(pool);
+	for (i = 0; i < pool->nreactors; i++) {
+		r = &pool->reactors[i];
+		evconnlistener_free(r->listener);
+		event_base_free(r->base);
+	}
+	free(pool->reactors);
+	free(pool);
+}
+
+int
+reactor_pool_size(struct reactor_pool *pool)
+{
+	return (pool->nreactors);
+}
+
+struct event_base *
+reactor_pool_base(struct reactor_pool *pool, int i)
+{
+	if (i < 0 || i >= pool->nreactors)
+		return (NULL);
+	return (pool->reactors[i].base);
+}
@@ -0,0 +1,29 @@
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+struct event_base;
+
+/*
+ * A pool of event_bases, one per thread and each pinned to its own CPU.
+ * Every base owns a SO_REUSEPORT listener bound to the same address, so
+ * the kernel spreads incoming connections across the threads.
+ */
+struct reactor_pool;
+
+/* Called on the accepting base's thread with a non-blocking fd. */
+typedef void (*reactor_accept_cb)(struct event_base *, int, void *);
+
+struct reactor_pool *reactor_pool_new(int nreactors,
+    const struct sockaddr *sa, socklen_t salen,
+    reactor_accept_cb cb, void *arg);
+int reactor_pool_start(struct reactor_pool *);
+void reactor_pool_stop(struct reactor_pool *);
+void reactor_pool_free(struct reactor_pool *);
+
+int reactor_pool_size(struct reactor_pool *);
+struct event_base *reactor_pool_base(struct reactor_pool *, int);
+
+#endif /* _REACTOR_H_ */
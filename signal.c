@@ -3,12 +3,15 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/socket.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
 #include <assert.h>
 #include <signal.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "event.h"
 #include "event-internal.h"
@@ -16,9 +19,34 @@
 #include "log.h"
 #include "evutil.h"
 
-struct event_base *evsignal_base = NULL;
+/*
+ * sigaction() handlers are process-wide, so the handler fans each signal
+ * out to every base watching it.  Bases publish themselves in
+ * evsignal_bases[] and flag the signals they watch in evsigwatched[];
+ * the handler reads both without taking a lock.  evsignal_lock only
+ * serialises installing and restoring the handlers.
+ *
+ * With EVENT_USE_SIGNALFD the first base to watch a signal also blocks
+ * it in its thread and reads it from a signalfd; that choice holds until
+ * the base stops watching.  The handler stays installed regardless, so a
+ * thread that has the signal unblocked still hands it to every base, and
+ * the owner fans out what its signalfd reads to the other watchers.
+ */
+#define EVSIGNAL_MAX_BASES 64
+
+static struct event_base *evsignal_bases[EVSIGNAL_MAX_BASES];
+static int evsignal_handlers_running;
+static pthread_mutex_t evsignal_lock = PTHREAD_MUTEX_INITIALIZER;
+static int evsignal_nwatchers[NSIG];
+static struct sigaction evsignal_sh_old[NSIG];
+static struct event_base *evsignal_sigfd_owner[NSIG];
 
 static void evsignal_handler(int sig);
+static void evsignal_activate(struct event_base *, int, int);
+static int evsignal_sigfd_update(struct event_base *, int, int);
+
+/* signalfd_siginfo records read per wakeup */
+#define EVSIGNAL_SIGFD_BATCH 16
 
 
 
@@ -29,53 +57,92 @@ static void evsignal_handler(int sig);
 } while (0)
 
 
-/* Helper: set the signal handler for evsignal to handler in base, so that
- *  * we can restore the original handler when we clear the current one. */
-int
-_evsignal_set_handler(struct event_base *base,
-                      int evsignal, void (*handler)(int))
+/* Route evsignal to base, installing our handler if no base had it yet. */
+static int
+evsignal_watch(struct event_base *base, int evsignal)
 {
-    struct sigaction sa;
     struct evsignal_info *sig = &base->sig;
-    void *p;
-
-    if (evsignal >= sig->sh_old_max) {
-        int new_max = evsignal + 1;
-        event_debug(("%s: evsignal (%d) >= sh_old_max (%d), resizing",
-                    __func__, evsignal, sig->sh_old_max));
-        p = realloc(sig->sh_old, new_max * sizeof(*sig->sh_old));
-        if (p == NULL) {
-            event_warn("realloc");
-            return (-1);
+    struct sigaction sa;
+    int i, res = 0;
+
+    pthread_mutex_lock(&evsignal_lock);
+    if (sig->slot == -1) {
+        for (i = 0; i < EVSIGNAL_MAX_BASES; i++)
+            if (evsignal_bases[i] == NULL)
+                break;
+        if (i == EVSIGNAL_MAX_BASES) {
+            event_warn("%s: too many bases with signal events", __func__);
+            res = -1;
+            goto out;
         }
-
-        memset((char *)p + sig->sh_old_max * sizeof(*sig->sh_old),
-                0, (new_max - sig->sh_old_max) * sizeof(*sig->sh_old));
-
-        sig->sh_old_max = new_max;
-        sig->sh_old = p;
+        __atomic_store_n(&evsignal_bases[i], base, __ATOMIC_RELEASE);
+        sig->slot = i;
     }
 
-    /* allocate space for previous handler out of dynamic array */
-    sig->sh_old[evsignal] = malloc(sizeof *sig->sh_old[evsignal]);
-    if (sig->sh_old[evsignal] == NULL) {
-        event_warn("malloc");
-        return (-1);
+    if (evsignal_nwatchers[evsignal] == 0) {
+        /* save previous handler and setup new handler */
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = evsignal_handler;
+        sa.sa_flags |= SA_RESTART;
+        sigfillset(&sa.sa_mask);
+
+        if (sigaction(evsignal, &sa, &evsignal_sh_old[evsignal]) == -1) {
+            event_warn("sigaction");
+            res = -1;
+            goto out;
+        }
+        /* blocked only once the handler catches it in other threads */
+        if (sig->signalfd != -1 &&
+                evsignal_sigfd_update(base, evsignal, 1) == 0)
+            evsignal_sigfd_owner[evsignal] = base;
     }
+    evsignal_nwatchers[evsignal]++;
+    sig->evsigwatched[evsignal] = 1;
 
-    /* save previous handler and setup new handler */
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = handler;
-    sa.sa_flags |= SA_RESTART;
-    sigfillset(&sa.sa_mask);
+out:
+    pthread_mutex_unlock(&evsignal_lock);
+    return (res);
+}
 
-    if (sigaction(evsignal, &sa, sig->sh_old[evsignal]) == -1) {
+/* Stop routing evsignal to base; the last base restores the old handler. */
+static int
+evsignal_unwatch(struct event_base *base, int evsignal)
+{
+    int res = 0;
+
+    pthread_mutex_lock(&evsignal_lock);
+    /* a signal pending meanwhile goes to the handler, still installed */
+    if (evsignal_sigfd_owner[evsignal] == base) {
+        evsignal_sigfd_update(base, evsignal, 0);
+        evsignal_sigfd_owner[evsignal] = NULL;
+    }
+    base->sig.evsigwatched[evsignal] = 0;
+    if (--evsignal_nwatchers[evsignal] == 0 &&
+            sigaction(evsignal, &evsignal_sh_old[evsignal], NULL) == -1) {
         event_warn("sigaction");
-        free(sig->sh_old[evsignal]);
-        return (-1);
+        res = -1;
     }
+    pthread_mutex_unlock(&evsignal_lock);
+    return (res);
+}
 
-    return (0);
+/* Take base out of evsignal_bases[] and wait out handlers still using it. */
+static void
+evsignal_unpublish(struct event_base *base)
+{
+    struct evsignal_info *sig = &base->sig;
+
+    pthread_mutex_lock(&evsignal_lock);
+    if (sig->slot != -1) {
+        __atomic_store_n(&evsignal_bases[sig->slot], NULL, __ATOMIC_SEQ_CST);
+        sig->slot = -1;
+    }
+    pthread_mutex_unlock(&evsignal_lock);
+
+    /* sequentially consistent, like the handler's side: a handler either
+     * sees the NULL or is counted here */
+    while (__atomic_load_n(&evsignal_handlers_running, __ATOMIC_SEQ_CST))
+        sched_yield();
 }
 
 
@@ -87,6 +154,27 @@ _evsignal_set_handler(struct event_base *base,
 
 
 
+/* Count ncalls of sig on every base watching it but skip, and wake them. */
+static void
+evsignal_fanout(int sig, int ncalls, struct event_base *skip)
+{
+    struct event_base *base;
+    int i;
+
+    __atomic_add_fetch(&evsignal_handlers_running, 1, __ATOMIC_SEQ_CST);
+    for (i = 0; i < EVSIGNAL_MAX_BASES; i++) {
+        base = __atomic_load_n(&evsignal_bases[i], __ATOMIC_SEQ_CST);
+        if (base == NULL || base == skip || !base->sig.evsigwatched[sig])
+            continue;
+        __atomic_add_fetch(&base->sig.evsigcaught[sig], ncalls,
+                __ATOMIC_RELAXED);
+        base->sig.evsignal_caught = 1;
+        /* Wake up our notification mechanism */
+        send(base->sig.ev_signal_pair[0], "a", 1, 0);
+    }
+    __atomic_sub_fetch(&evsignal_handlers_running, 1, __ATOMIC_ACQ_REL);
+}
+
 static void
 evsignal_cb(int fd, short what, void *arg)
 {
@@ -98,10 +186,105 @@ evsignal_cb(int fd, short what, void *arg)
 }
 
 
-int 
-evsignal_init(struct event_base *base)
+/* Everything that arrived since the last wakeup, in one read per batch. */
+static void
+evsignal_sigfd_cb(int fd, short what, void *arg)
+{
+    struct event_base *base = arg;
+    struct signalfd_siginfo info[EVSIGNAL_SIGFD_BATCH];
+    int counts[NSIG];
+    ssize_t n;
+    int i, nrec, signo;
+
+    for (;;) {
+        n = read(fd, info, sizeof(info));
+        if (n == -1) {
+            if (errno != EAGAIN && errno != EINTR)
+                event_warn("%s: read", __func__);
+            return;
+        }
+        nrec = n / sizeof(struct signalfd_siginfo);
+
+        /* coalesce repeats, touching only the signals that arrived */
+        for (i = 0; i < nrec; i++)
+            counts[info[i].ssi_signo] = 0;
+        for (i = 0; i < nrec; i++)
+            counts[info[i].ssi_signo]++;
+        for (i = 0; i < nrec; i++) {
+            signo = info[i].ssi_signo;
+            if (counts[signo] == 0)
+                continue;
+            evsignal_activate(base, signo, counts[signo]);
+            /* blocked everywhere, so the other watchers saw nothing */
+            evsignal_fanout(signo, counts[signo], base);
+            counts[signo] = 0;
+        }
+
+        if (nrec < EVSIGNAL_SIGFD_BATCH)
+            return;
+    }
+}
+
+static int
+evsignal_init_signalfd(struct event_base *base)
+{
+    struct evsignal_info *sig = &base->sig;
+
+    sigemptyset(&sig->sigfd_mask);
+    sigemptyset(&sig->sigfd_blocked);
+    sig->signalfd = signalfd(-1, &sig->sigfd_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sig->signalfd == -1) {
+        event_warn("%s: signalfd", __func__);
+        return (-1);
+    }
+
+    event_set(&sig->ev_sigfd, sig->signalfd, EV_READ | EV_PERSIST,
+            evsignal_sigfd_cb, base);
+    sig->ev_sigfd.ev_base = base;
+    sig->ev_sigfd.ev_flags |= EVLIST_INTERNAL;
+    return (0);
+}
+
+/* Block evsignal and route it through the signalfd, or undo that. */
+static int
+evsignal_sigfd_update(struct event_base *base, int evsignal, int on)
+{
+    struct evsignal_info *sig = &base->sig;
+    sigset_t set, old;
+
+    sigemptyset(&set);
+    sigaddset(&set, evsignal);
+    if (on) {
+        if (pthread_sigmask(SIG_BLOCK, &set, &old) != 0)
+            return (-1);
+        if (!sigismember(&old, evsignal))
+            sigaddset(&sig->sigfd_blocked, evsignal);
+        sigaddset(&sig->sigfd_mask, evsignal);
+    } else {
+        sigdelset(&sig->sigfd_mask, evsignal);
+    }
+
+    if (signalfd(sig->signalfd, &sig->sigfd_mask, 0) == -1) {
+        event_warn("%s: signalfd", __func__);
+        if (!on)
+            return (-1);
+        /* leave it to the handler */
+        sigdelset(&sig->sigfd_mask, evsignal);
+        on = 0;
+    }
+
+    /* unblock only after the signalfd stopped claiming it */
+    if (!on && sigismember(&sig->sigfd_blocked, evsignal)) {
+        sigdelset(&sig->sigfd_blocked, evsignal);
+        pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    }
+    return (0);
+}
+
+/* The pair the handler wakes the loop through. */
+static int
+evsignal_init_socketpair(struct event_base *base)
 {
-    int i;
     if (evutil_socketpair(
                 AF_UNIX, SOCK_STREAM, 0, base->sig.ev_signal_pair) == -1) {
         event_warn("%s: socketpair", __func__);
@@ -110,17 +293,35 @@ evsignal_init(struct event_base *base)
 
     FD_CLOSEONEXEC(base->sig.ev_signal_pair[0]);
     FD_CLOSEONEXEC(base->sig.ev_signal_pair[1]);
-    base->sig.sh_old = NULL;
-    base->sig.sh_old_max = 0;
+    evutil_make_socket_nonblocking(base->sig.ev_signal_pair[0]);
+    return (0);
+}
+
+int 
+evsignal_init(struct event_base *base)
+{
+    int i;
+
+    if (evsignal_init_socketpair(base) == -1)
+        return -1;
+
+    event_set(&base->sig.ev_signal, base->sig.ev_signal_pair[1],
+            EV_READ | EV_PERSIST, evsignal_cb, &base->sig.ev_signal);
+
+    /* Also read signals from a signalfd when this environment variable
+     * is set.  Not the default: it only helps while the signal is blocked
+     * in every thread; otherwise the handler delivers it all the same. */
+    base->sig.signalfd = -1;
+    if (evutil_getenv("EVENT_USE_SIGNALFD"))
+        evsignal_init_signalfd(base);
+
+    base->sig.slot = -1;
+    memset((void *)base->sig.evsigwatched, 0, sizeof(sig_atomic_t)*NSIG);
     base->sig.evsignal_caught = 0;
     memset(&base->sig.evsigcaught, 0, sizeof(sig_atomic_t)*NSIG);
     for (i = 0; i < NSIG; ++i)
         TAILQ_INIT(&base->sig.evsigevents[i]);
 
-    evutil_make_socket_nonblocking(base->sig.ev_signal_pair[0]);
-
-    event_set(&base->sig.ev_signal, base->sig.ev_signal_pair[1],
-            EV_READ | EV_PERSIST, evsignal_cb, &base->sig.ev_signal);
     base->sig.ev_signal.ev_base = base;
     base->sig.ev_signal.ev_flags |= EVLIST_INTERNAL;
     return 0;
@@ -140,17 +341,17 @@ int evsignal_add(struct event *ev)
     if (TAILQ_EMPTY(&sig->evsigevents[evsignal]))
     {
         event_debug(("%s: %p: changing signal handler", __func__, ev));
-        if (_evsignal_set_handler(
-                    base, evsignal, evsignal_handler) == -1)
+        if (evsignal_watch(base, evsignal) == -1)
             return (-1);
 
-        /* catch signals if they happen quickly */
-        evsignal_base = base;
-
         if (!sig->ev_signal_added)
         {
             if (event_add(&sig->ev_signal, NULL))
                 return (-1);
+            if (sig->signalfd != -1 && event_add(&sig->ev_sigfd, NULL)) {
+                event_del(&sig->ev_signal);
+                return (-1);
+            }
             sig->ev_signal_added = 1;
         }
     }
@@ -162,25 +363,6 @@ int evsignal_add(struct event *ev)
 }
 
 
-int
-_evsignal_restore_handler(struct event_base *base, int evsignal)
-{
-    int ret = 0;
-    struct evsignal_info *sig = &base->sig;
-    struct sigaction *sh;
-
-    /* restore previous handler */
-    sh = sig->sh_old[evsignal];
-    sig->sh_old[evsignal] = NULL;
-    if (sigaction(evsignal, sh, NULL) == -1) {
-        event_warn("sigaction");
-        ret = -1;
-    }
-    free(sh);
-    return ret;
-}
-
-
 int
 evsignal_del(struct event *ev)
 {
@@ -198,7 +380,7 @@ evsignal_del(struct event *ev)
 
     event_debug(("%s: %p: restoring signal handler", __func__, ev));
 
-    return (_evsignal_restore_handler(ev->ev_base, EVENT_SIGNAL(ev)));
+    return (evsignal_unwatch(base, evsignal));
 }
 
 
@@ -208,41 +390,38 @@ evsignal_handler(int sig)
 {
     int save_errno = errno;
 
-    if (evsignal_base == NULL) {
-        event_warn(
-                "%s: received signal %d, but have no base configured",
-                __func__, sig);
-        return;
-    }
-    evsignal_base->sig.evsigcaught[sig]++;
-    evsignal_base->sig.evsignal_caught = 1;
-    /* Wake up our notification mechanism */
-    send(evsignal_base->sig.ev_signal_pair[0], "a", 1, 0);
+    evsignal_fanout(sig, 1, NULL);
     errno = save_errno;
 }
 
 
+static void
+evsignal_activate(struct event_base *base, int evsignal, int ncalls)
+{
+    struct event *ev, *next_ev;
+
+    for (ev = TAILQ_FIRST(&base->sig.evsigevents[evsignal]);
+            ev != NULL; ev = next_ev) {
+        next_ev = TAILQ_NEXT(ev, ev_signal_next);
+        if (!(ev->ev_events & EV_PERSIST))
+            event_del(ev);
+        event_active(ev, EV_SIGNAL, ncalls);
+    }
+}
+
 void
 evsignal_process(struct event_base *base)
 {
     struct evsignal_info *sig = &base->sig;
-    struct event *ev, *next_ev;
     sig_atomic_t ncalls;
     int i;
     base->sig.evsignal_caught = 0;
     for (i = 1; i < NSIG; ++i) {
-        ncalls = sig->evsigcaught[i];
+        ncalls = __atomic_load_n(&sig->evsigcaught[i], __ATOMIC_RELAXED);
         if (ncalls == 0)
             continue;
-        sig->evsigcaught[i] -= ncalls;
-
-        for (ev = TAILQ_FIRST(&sig->evsigevents[i]);
-                ev != NULL; ev = next_ev) {
-            next_ev = TAILQ_NEXT(ev, ev_signal_next);
-            if (!(ev->ev_events & EV_PERSIST))
-                event_del(ev);
-            event_active(ev, EV_SIGNAL, ncalls);
-        }
+        __atomic_sub_fetch(&sig->evsigcaught[i], ncalls, __ATOMIC_RELAXED);
+        evsignal_activate(base, i, ncalls);
     }
 }
 
@@ -252,19 +431,23 @@ evsignal_dealloc(struct event_base *base)
     int i = 0;
     if (base->sig.ev_signal_added) {
         event_del(&base->sig.ev_signal);
+        if (base->sig.signalfd != -1)
+            event_del(&base->sig.ev_sigfd);
         base->sig.ev_signal_added = 0;
     }
     for (i = 0; i < NSIG; ++i) {
-        if (i < base->sig.sh_old_max && base->sig.sh_old[i] != NULL)
-            _evsignal_restore_handler(base, i);
+        if (base->sig.evsigwatched[i])
+            evsignal_unwatch(base, i);
+    }
+    evsignal_unpublish(base);
+    if (base->sig.signalfd != -1) {
+        close(base->sig.signalfd);
+        base->sig.signalfd = -1;
     }
     EVUTIL_CLOSESOCKET(base->sig.ev_signal_pair[0]);
     base->sig.ev_signal_pair[0] = -1;
     EVUTIL_CLOSESOCKET(base->sig.ev_signal_pair[1]);
     base->sig.ev_signal_pair[1] = -1;
-    base->sig.sh_old_max = 0;
-    /* per index frees are handled in evsignal_del() */
-    free(base->sig.sh_old);
 }
 
 
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+#include "event.h"
+
+
+
+#define NPRIORITIES	3
+#define NBATCH		50
+
+int test_okay = 1;
+int flood_called = 0;
+int low_called = 0;
+struct event_base *base;
+unsigned long ran_in[NBATCH];   /* loop iteration each callback ran in */
+int nran;
+
+
+/* Keeps its own priority queue busy forever. */
+static void
+flood_cb(int fd, short event, void *arg)
+{
+    struct event *ev = arg;
+
+    flood_called++;
+    event_active(ev, EV_TIMEOUT, 1);
+}
+
+static void
+low_cb(int fd, short event, void *arg)
+{
+    low_called++;
+    event_base_loopbreak(base);
+}
+
+/* Every iteration takes one backend syscall, so it tells them apart. */
+static void
+batch_cb(int fd, short event, void *arg)
+{
+    ran_in[nran++] = event_base_get_backend_syscalls(base);
+    if (arg != NULL)
+        usleep(1000);
+}
+
+/*
+ * Activate NBATCH callbacks, each sleeping 1ms if slow, run them all and
+ * return the most that ran in one iteration; *niter gets the iterations.
+ */
+static int
+run_batch(int slow, int *niter)
+{
+    struct event evs[NBATCH];
+    int i, n = 0, most = 0;
+
+    nran = 0;
+    for (i = 0; i < NBATCH; i++) {
+        evtimer_set(&evs[i], batch_cb, slow ? &evs[i] : NULL);
+        event_base_set(base, &evs[i]);
+        event_active(&evs[i], EV_TIMEOUT, 1);
+    }
+    event_base_loop(base, EVLOOP_ONCE);
+    if (nran != NBATCH)
+        test_okay = 0;
+
+    *niter = 0;
+    for (i = 0; i < nran; i++) {
+        if (i == 0 || ran_in[i] != ran_in[i - 1]) {
+            (*niter)++;
+            n = 0;
+        }
+        if (++n > most)
+            most = n;
+    }
+    return (most);
+}
+
+/* The callback count alone caps each iteration exactly. */
+static void
+test_max_callbacks(void)
+{
+    int most, niter;
+
+    base = event_base_new();
+    if (event_base_set_max_dispatch(base, 10, NULL) == -1)
+        test_okay = 0;
+    most = run_batch(0, &niter);
+    printf("%s: at most %d callbacks per iteration, %d iterations\n",
+            __func__, most, niter);
+    if (most != 10 || niter != NBATCH / 10)
+        test_okay = 0;
+    event_base_free(base);
+}
+
+/*
+ * The time slice alone ends an iteration once it has passed; it is
+ * checked every few callbacks, so allow some overrun, but far fewer
+ * than the whole batch of 1ms callbacks may run in a 2ms slice.
+ */
+static void
+test_time_slice(void)
+{
+    struct timeval slice = {0, 2000};
+    int most, niter;
+
+    base = event_base_new();
+    if (event_base_set_max_dispatch(base, 0, &slice) == -1)
+        test_okay = 0;
+    most = run_batch(1, &niter);
+    printf("%s: at most %d callbacks per iteration, %d iterations\n",
+            __func__, most, niter);
+    if (most < 2 || most > 16 || niter < NBATCH / 16)
+        test_okay = 0;
+    event_base_free(base);
+}
+
+/*
+ * A flood at the highest priority must not stop a timer at the lowest
+ * one from running once a budget and priority weights are set.
+ */
+static void
+test_weights(void)
+{
+    struct event flood, low;
+    struct timeval tv = {0, 10000};
+    struct timeval slice = {0, 2000};
+    int weights[NPRIORITIES] = { 64, 16, 4 };
+
+    base = event_base_new();
+    event_base_priority_init(base, NPRIORITIES);
+    if (event_base_set_max_dispatch(base, 128, &slice) == -1 ||
+            event_base_set_priority_weights(base, weights) == -1) {
+        test_okay = 0;
+        return;
+    }
+
+    evtimer_set(&flood, flood_cb, &flood);
+    event_base_set(base, &flood);
+    event_priority_set(&flood, 0);
+    event_active(&flood, EV_TIMEOUT, 1);
+
+    evtimer_set(&low, low_cb, NULL);
+    event_base_set(base, &low);
+    event_priority_set(&low, NPRIORITIES - 1);
+    evtimer_add(&low, &tv);
+
+    event_base_loop(base, 0);
+
+    printf("%s: %d flood callbacks before the low priority timer ran\n",
+            __func__, flood_called);
+    if (low_called != 1)
+        test_okay = 0;
+
+    event_base_free(base);
+}
+
+int
+main (int argc, char **argv)
+{
+    alarm(10);
+
+    test_max_callbacks();
+    test_time_slice();
+    test_weights();
+
+    return (!test_okay);
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+#include "event.h"
+#include "evutil.h"
+#include "buffer.h"
+#include "bufferevent.h"
+
+
+
+#define NBYTES  (1024 * 1024)
+
+int test_okay = 1;
+int reads, writes, errors;
+short error_what;
+size_t received;
+int drain;
+
+
+static void
+read_cb(struct bufferevent *bev, void *arg)
+{
+    char buf[4096];
+    size_t n;
+
+    reads++;
+    if (!drain)
+        return;
+    while ((n = bufferevent_read(bev, buf, sizeof(buf))) > 0)
+        received += n;
+}
+
+static void
+write_cb(struct bufferevent *bev, void *arg)
+{
+    writes++;
+}
+
+static void
+error_cb(struct bufferevent *bev, short what, void *arg)
+{
+    errors++;
+    error_what = what;
+}
+
+static void
+spin(struct event_base *base)
+{
+    int i;
+
+    for (i = 0; i < 10; i++)
+        event_base_loop(base, EVLOOP_NONBLOCK);
+}
+
+int
+main (int argc, char **argv)
+{
+    struct event_base *base;
+    struct bufferevent *rd, *wr;
+    struct timeval tv = { 0, 50000 };
+    char buf[256], *big;
+    int pair[2];
+
+    alarm(10);
+
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1 ||
+            evutil_make_socket_nonblocking(pair[0]) == -1 ||
+            evutil_make_socket_nonblocking(pair[1]) == -1)
+        return (1);
+    base = event_base_new();
+    rd = bufferevent_new(base, pair[1], read_cb, NULL, error_cb, NULL);
+    wr = bufferevent_new(base, pair[0], NULL, write_cb, error_cb, NULL);
+
+    /* the read callback waits for the low watermark, and reading stops
+     * at the high one until the input is drained */
+    bufferevent_setwatermark(rd, EV_READ, 10, 64);
+    bufferevent_enable(rd, EV_READ);
+    memset(buf, 'x', sizeof(buf));
+    write(pair[0], buf, 5);
+    spin(base);
+    if (reads != 0)
+        test_okay = 0;
+    write(pair[0], buf, 5);
+    spin(base);
+    if (reads != 1 || EVBUFFER_LENGTH(bufferevent_get_input(rd)) != 10)
+        test_okay = 0;
+    write(pair[0], buf, sizeof(buf));
+    spin(base);
+    printf("%s: %zu bytes buffered at a high watermark of 64\n", __func__,
+            EVBUFFER_LENGTH(bufferevent_get_input(rd)));
+    if (EVBUFFER_LENGTH(bufferevent_get_input(rd)) != 64)
+        test_okay = 0;
+    bufferevent_read(rd, buf, 64);
+    spin(base);
+    if (EVBUFFER_LENGTH(bufferevent_get_input(rd)) != 64)
+        test_okay = 0;
+
+    /* a large write drains in the background and the write event goes
+     * away once the output is empty */
+    drain = 1;
+    bufferevent_setwatermark(rd, EV_READ, 0, 0);
+    bufferevent_read(rd, buf, sizeof(buf));
+    spin(base);
+    received = 0;
+    big = calloc(1, NBYTES);
+    bufferevent_write(wr, big, NBYTES);
+    while (test_okay && (writes == 0 || received < NBYTES))
+        event_base_loop(base, EVLOOP_ONCE);
+    spin(base);
+    printf("%s: %zu bytes received, write callback ran %d time(s)\n",
+            __func__, received, writes);
+    if (received != NBYTES || writes != 1)
+        test_okay = 0;
+
+    /* nothing arrives: the read timeout fires and disables reading */
+    bufferevent_set_timeouts(rd, &tv, NULL);
+    event_base_loop(base, 0);
+    printf("%s: error callback ran %d time(s) with %#x\n", __func__, errors,
+            error_what);
+    if (errors != 1 || error_what != (EVBUFFER_READ | EVBUFFER_TIMEOUT))
+        test_okay = 0;
+
+    free(big);
+    bufferevent_free(rd);
+    bufferevent_free(wr);
+    event_base_free(base);
+    close(pair[0]);
+    close(pair[1]);
+    return (!test_okay);
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+#define NWRITES	100
+
+int test_okay = 1;
+int nread, nwritten, called;
+struct event rev, wev;
+
+
+static void
+write_cb(int fd, short event, void *arg)
+{
+    if (write(fd, "x", 1) != 1)
+        test_okay = 0;
+    if (++nwritten < NWRITES)
+        event_add(&wev, NULL);
+}
+
+static void
+read_cb(int fd, short event, void *arg)
+{
+    char buf[64];
+    ssize_t n;
+
+    if ((n = read(fd, buf, sizeof(buf))) > 0)
+        nread += n;
+    if (nread == NWRITES)
+        event_del(&rev);
+}
+
+static void
+count_cb(int fd, short event, void *arg)
+{
+    called++;
+}
+
+/* One non-blocking pass; returns the backend syscalls it took. */
+static unsigned long
+pass(struct event_base *base)
+{
+    unsigned long before = event_base_get_backend_syscalls(base);
+
+    event_base_loop(base, EVLOOP_ONCE | EVLOOP_NONBLOCK);
+    return (event_base_get_backend_syscalls(base) - before);
+}
+
+/* Data flows with every epoll_ctl deferred to the dispatch. */
+static void
+traffic(struct event_base *base, int pair[2])
+{
+    nread = nwritten = 0;
+    event_set(&wev, pair[0], EV_WRITE, write_cb, NULL);
+    event_base_set(base, &wev);
+    event_set(&rev, pair[1], EV_READ | EV_PERSIST, read_cb, NULL);
+    event_base_set(base, &rev);
+    event_add(&wev, NULL);
+    event_add(&rev, NULL);
+
+    /* returns once everything written has been read */
+    event_base_loop(base, 0);
+    printf("%s: wrote %d, read %d\n", __func__, nwritten, nread);
+    if (nwritten != NWRITES || nread != NWRITES)
+        test_okay = 0;
+}
+
+/* An add and a delete before the next dispatch never reach the kernel. */
+static void
+cancel(struct event_base *base, int pair[2])
+{
+    struct event ev, keep;
+    unsigned long n;
+
+    /* keeps the loop dispatching; never ready */
+    event_set(&keep, pair[0], EV_READ, count_cb, NULL);
+    event_base_set(base, &keep);
+    event_add(&keep, NULL);
+    pass(base);
+
+    called = 0;
+    write(pair[0], "x", 1);
+    event_set(&ev, pair[1], EV_READ, count_cb, NULL);
+    event_base_set(base, &ev);
+    event_add(&ev, NULL);
+    event_del(&ev);
+    n = pass(base);
+    printf("%s: %lu backend syscalls, %d callbacks\n", __func__, n, called);
+    if (n != 1 || called != 0)
+        test_okay = 0;
+
+    event_del(&keep);
+    pass(base);
+}
+
+/*
+ * A delete and re-add before the next dispatch cost nothing while another
+ * event keeps the fd registered.  Once the fd lost every event it may
+ * have been closed and reopened meanwhile, so that case pays one MOD.
+ */
+static void
+readd(struct event_base *base, int pair[2])
+{
+    struct event ev, keep;
+    unsigned long n;
+
+    event_set(&keep, pair[1], EV_WRITE | EV_PERSIST, count_cb, NULL);
+    event_base_set(base, &keep);
+    event_set(&ev, pair[1], EV_READ | EV_PERSIST, count_cb, NULL);
+    event_base_set(base, &ev);
+    event_add(&keep, NULL);
+    event_add(&ev, NULL);
+    pass(base);
+
+    event_del(&ev);
+    event_add(&ev, NULL);
+    n = pass(base);
+    printf("%s: %lu backend syscalls with another event\n", __func__, n);
+    if (n != 1)
+        test_okay = 0;
+
+    event_del(&keep);
+    pass(base);
+    event_del(&ev);
+    event_add(&ev, NULL);
+    n = pass(base);
+    printf("%s: %lu backend syscalls as the only event\n", __func__, n);
+    if (n != 2)
+        test_okay = 0;
+
+    event_del(&ev);
+    pass(base);
+}
+
+/*
+ * Delete, close, reopen as the same fd number and add again before the
+ * next dispatch: the combined interest looks unchanged, but the kernel
+ * forgot the old file, so the new one must still be registered.
+ */
+static void
+reopen(struct event_base *base, int pair[2])
+{
+    struct event ev;
+    int fd = pair[1], npair[2], i;
+
+    event_set(&ev, fd, EV_READ | EV_PERSIST, count_cb, NULL);
+    event_base_set(base, &ev);
+    event_add(&ev, NULL);
+    pass(base);
+    event_del(&ev);
+    called = 0;
+
+    close(pair[0]);
+    close(pair[1]);
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, npair) == -1) {
+        test_okay = 0;
+        return;
+    }
+    if (npair[1] != fd) {
+        dup2(npair[1], fd);
+        close(npair[1]);
+    }
+    pair[0] = npair[0];
+    pair[1] = fd;
+
+    event_set(&ev, fd, EV_READ | EV_PERSIST, count_cb, NULL);
+    event_base_set(base, &ev);
+    event_add(&ev, NULL);
+    write(pair[0], "x", 1);
+    for (i = 0; i < 3 && called == 0; i++)
+        pass(base);
+    printf("%s: fd %d reported %d time(s)\n", __func__, fd, called);
+    if (called == 0)
+        test_okay = 0;
+    event_del(&ev);
+    pass(base);
+}
+
+int
+main (int argc, char **argv)
+{
+    struct event_base *base;
+    int pair[2];
+
+    alarm(10);
+
+    setenv("EVENT_EPOLL_USE_CHANGELIST", "1", 1);
+    if ((base = event_base_new()) == NULL)
+        return (1);
+    if (strcmp(event_base_get_method(base), "epoll") != 0) {
+        /* the changelist is epoll's */
+        event_base_free(base);
+        return (0);
+    }
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+        return (1);
+
+    traffic(base, pair);
+    cancel(base, pair);
+    readd(base, pair);
+    reopen(base, pair);
+
+    event_base_free(base);
+    close(pair[0]);
+    close(pair[1]);
+    return (!test_okay);
+}
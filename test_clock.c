@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+
+#include "event.h"
+
+
+
+#define NTIMERS	20
+
+int test_okay = 1;
+int called = 0;
+int early = 0;
+long slack;         /* ns a timer may fire early on a coarse clock */
+struct event_base *base;
+
+struct timer {
+    struct event ev;
+    struct timespec due;    /* CLOCK_MONOTONIC */
+};
+
+
+static void
+timer_cb(int fd, short event, void *arg)
+{
+    struct timer *t = arg;
+    struct timespec now;
+    struct timeval wall, cached;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((t->due.tv_sec - now.tv_sec) * 1000000000L +
+            (t->due.tv_nsec - now.tv_nsec) > slack)
+        early++;
+
+    /* the cached wall time is the loop's timestamp, so a little behind */
+    gettimeofday(&wall, NULL);
+    event_base_gettimeofday_cached(base, &cached);
+    if (cached.tv_sec < wall.tv_sec - 1 || cached.tv_sec > wall.tv_sec + 1)
+        test_okay = 0;
+
+    called++;
+}
+
+static void
+run(const char *name, int source)
+{
+    struct timer timers[NTIMERS];
+    struct timespec res;
+    struct timeval tv;
+    int i;
+
+    base = event_base_new();
+    if (event_base_set_clock(base, source) == -1) {
+        printf("%s: %s not available\n", __func__, name);
+        event_base_free(base);
+        return;
+    }
+
+    /* a coarse clock lags by up to a tick, and ticks can land late */
+    slack = 0;
+    if (source == EVENT_CLOCK_COARSE &&
+            clock_getres(CLOCK_MONOTONIC_COARSE, &res) == 0)
+        slack = 2 * res.tv_nsec;
+
+    called = early = 0;
+    for (i = 0; i < NTIMERS; i++) {
+        tv.tv_sec = 0;
+        tv.tv_usec = 1000 * (i + 1);
+        clock_gettime(CLOCK_MONOTONIC, &timers[i].due);
+        timers[i].due.tv_nsec += tv.tv_usec * 1000;
+        if (timers[i].due.tv_nsec >= 1000000000) {
+            timers[i].due.tv_sec++;
+            timers[i].due.tv_nsec -= 1000000000;
+        }
+        evtimer_set(&timers[i].ev, timer_cb, &timers[i]);
+        event_base_set(base, &timers[i].ev);
+        evtimer_add(&timers[i].ev, &tv);
+    }
+
+    event_base_loop(base, 0);
+    printf("%s: %s: %d of %d timers, %d early\n", __func__, name,
+            called, NTIMERS, early);
+    if (called != NTIMERS || early)
+        test_okay = 0;
+    event_base_free(base);
+}
+
+int
+main (int argc, char **argv)
+{
+    run("monotonic", EVENT_CLOCK_MONOTONIC);
+    run("coarse", EVENT_CLOCK_COARSE);
+    run("tsc", EVENT_CLOCK_TSC);
+    return (!test_okay);
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+#define NEVENTS		6
+#define SHORT_USEC	20000	/* common timeout the A events share */
+#define LONG_USEC	40000	/* second common timeout */
+#define PLAIN_USEC	10000	/* ordinary timer in the same store */
+
+/* tv_usec layout of a common timeout, see event.c */
+#define MAGIC_MASK	0xf0000000
+#define MAGIC		0x50000000
+#define IDX(tv)		(((tv)->tv_usec & 0x0ff00000) >> 20)
+#define USEC(tv)	((tv)->tv_usec & 0x000fffff)
+
+int test_okay = 1;
+
+struct timer {
+	const char *name;
+	struct event ev;
+	struct timeval deadline;
+};
+
+struct timer timers[NEVENTS];
+const char *fired[NEVENTS];
+int nfired;
+
+
+static void
+now_tv(struct timeval *tv)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+}
+
+static void
+time_cb(int fd, short event, void *arg)
+{
+	struct timer *t = arg;
+	struct timeval now;
+
+	now_tv(&now);
+	if (evutil_timercmp(&now, &t->deadline, <)) {
+		printf("%s: %s fired early\n", __func__, t->name);
+		test_okay = 0;
+	}
+	if (nfired < NEVENTS)
+		fired[nfired] = t->name;
+	nfired++;
+}
+
+/* Add t with the (possibly common) timeout tv of usec microseconds. */
+static void
+add(struct timer *t, const struct timeval *tv, long usec)
+{
+	struct timeval d = {0, usec};
+
+	/* taken before event_add(), so never later than the base's deadline */
+	now_tv(&t->deadline);
+	evutil_timeradd(&t->deadline, &d, &t->deadline);
+	evtimer_add(&t->ev, tv);
+}
+
+static void
+check_encoding(const struct timeval *tv, int idx, long sec, long usec)
+{
+	if ((tv->tv_usec & MAGIC_MASK) != MAGIC || IDX(tv) != idx ||
+	    tv->tv_sec != sec || USEC(tv) != usec) {
+		printf("%s: bad encoding %ld.%08lx for index %d\n", __func__,
+		    (long)tv->tv_sec, (long)tv->tv_usec, idx);
+		test_okay = 0;
+	}
+}
+
+static void
+run(int method, const char *name)
+{
+	static const char *names[NEVENTS] = {
+		"A0", "A1", "A2", "A3", "C", "B"
+	};
+	static const char *expect[] = {
+		"B", "A2", "A4", "A1", "C", "A3"
+	};
+	struct timeval tv_short = {0, SHORT_USEC}, tv_long = {0, LONG_USEC};
+	struct timeval tv_plain = {0, PLAIN_USEC}, tv_norm = {0, 1500000};
+	const struct timeval *ct_short, *ct_long, *ct_norm;
+	struct event_base *base;
+	struct timer a4 = { "A4" };
+	unsigned long syscalls;
+	int i;
+
+	base = event_base_new();
+	if (event_base_set_timeout_method(base, method) == -1) {
+		printf("%s: %s: cannot select\n", __func__, name);
+		test_okay = 0;
+		event_base_free(base);
+		return;
+	}
+
+	/* the index and magic ride in the high bits of tv_usec */
+	ct_short = event_base_init_common_timeout(base, &tv_short);
+	ct_long = event_base_init_common_timeout(base, &tv_long);
+	ct_norm = event_base_init_common_timeout(base, &tv_norm);
+	check_encoding(ct_short, 0, 0, SHORT_USEC);
+	check_encoding(ct_long, 1, 0, LONG_USEC);
+	check_encoding(ct_norm, 2, 1, 500000);
+	if (event_base_init_common_timeout(base, &tv_short) != ct_short ||
+	    event_base_init_common_timeout(base, ct_long) != ct_long) {
+		printf("%s: %s: duration not shared\n", __func__, name);
+		test_okay = 0;
+	}
+
+	nfired = 0;
+	for (i = 0; i < NEVENTS; i++) {
+		timers[i].name = names[i];
+		evtimer_set(&timers[i].ev, time_cb, &timers[i]);
+		event_base_set(base, &timers[i].ev);
+	}
+	evtimer_set(&a4.ev, time_cb, &a4);
+	event_base_set(base, &a4.ev);
+
+	for (i = 0; i < 4; i++)
+		add(&timers[i], ct_short, SHORT_USEC);
+	add(&a4, ct_short, SHORT_USEC);
+	add(&timers[4], ct_long, LONG_USEC);
+	add(&timers[5], &tv_plain, PLAIN_USEC);
+	usleep(5000);
+
+	/* deleting the head moves the list's timer to A1 */
+	evtimer_del(&timers[0].ev);
+	/* re-adding the live head sends it to the tail, after A4 */
+	add(&timers[1], ct_short, SHORT_USEC);
+	/* and a live event can move to another common timeout */
+	add(&timers[3], ct_long, LONG_USEC);
+
+	event_base_loop(base, 0);
+
+	printf("%s: %s:", __func__, name);
+	for (i = 0; i < nfired && i < NEVENTS; i++)
+		printf(" %s", fired[i]);
+	printf("\n");
+	if (nfired != NEVENTS)
+		test_okay = 0;
+	for (i = 0; i < nfired && i < NEVENTS; i++)
+		if (strcmp(fired[i], expect[i]) != 0)
+			test_okay = 0;
+
+	/*
+	 * Emptying a list by deleting its head must disarm the list's timer:
+	 * the loop then wakes once, for the plain timer, not at the stale
+	 * deadline first.
+	 */
+	nfired = 0;
+	add(&timers[0], ct_short, SHORT_USEC);
+	add(&timers[5], &tv_long, LONG_USEC);
+	evtimer_del(&timers[0].ev);
+	syscalls = event_base_get_backend_syscalls(base);
+	event_base_loop(base, 0);
+	syscalls = event_base_get_backend_syscalls(base) - syscalls;
+	printf("%s: %s: %lu wakeup(s) after deleting the only event\n",
+	    __func__, name, syscalls);
+	if (nfired != 1 || syscalls != 1)
+		test_okay = 0;
+
+	event_base_free(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	alarm(10);
+
+	run(EVENT_TIMEOUT_HEAP, "heap");
+	run(EVENT_TIMEOUT_HEAP4, "heap4");
+	run(EVENT_TIMEOUT_WHEEL, "wheel");
+
+	return (!test_okay);
+}
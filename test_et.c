@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+#define NLOOPS	5
+
+int test_okay = 1;
+int called[2];          /* edge-triggered, level-triggered */
+
+
+/* Never reads, so the data stays queued on the fd. */
+static void
+read_cb(int fd, short event, void *arg)
+{
+    called[(intptr_t)arg]++;
+}
+
+static void
+spin(struct event_base *base)
+{
+    int i;
+
+    for (i = 0; i < NLOOPS; i++)
+        event_base_loop(base, EVLOOP_ONCE | EVLOOP_NONBLOCK);
+}
+
+static void
+expect(const char *what, int et, int lt)
+{
+    printf("%s: %s: edge %d, level %d\n", __func__, what, called[0],
+            called[1]);
+    if ((et != -1 && called[0] != et) || (lt != -1 && called[1] != lt))
+        test_okay = 0;
+}
+
+/*
+ * An EV_ET|EV_PERSIST reader is reported once per arrival however long
+ * the data sits unread.  A level-triggered reader added on the same fd
+ * turns the fd level-triggered, so it fires on every pass; once it is
+ * gone the edge-triggered reader goes quiet again.
+ */
+static void
+run(const char *method)
+{
+    struct event_base *base;
+    struct event et, lt;
+    int pair[2];
+
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+        test_okay = 0;
+        return;
+    }
+    if ((base = event_base_new()) == NULL) {
+        test_okay = 0;
+        return;
+    }
+    printf("%s: %s\n", __func__, event_base_get_method(base));
+    if (strcmp(event_base_get_method(base), method) != 0) {
+        /* backend not available here */
+        event_base_free(base);
+        return;
+    }
+
+    called[0] = called[1] = 0;
+    event_set(&et, pair[1], EV_READ | EV_ET | EV_PERSIST, read_cb,
+            (void *)0);
+    event_base_set(base, &et);
+    event_set(&lt, pair[1], EV_READ | EV_PERSIST, read_cb, (void *)1);
+    event_base_set(base, &lt);
+    event_add(&et, NULL);
+
+    write(pair[0], "a", 1);
+    spin(base);
+    expect("unread", 1, 0);
+
+    /* more data is a new edge */
+    write(pair[0], "b", 1);
+    spin(base);
+    expect("second write", 2, 0);
+
+    /* with a level-triggered reader the fd is level-triggered */
+    event_add(&lt, NULL);
+    spin(base);
+    expect("mixed", -1, NLOOPS);
+    if (called[0] < 2 + 1)
+        test_okay = 0;
+
+    /* back to edge-triggered: at most the re-arm reports it once more */
+    event_del(&lt);
+    called[0] = 0;
+    spin(base);
+    if (called[0] > 1)
+        test_okay = 0;
+    called[0] = 0;
+    spin(base);
+    expect("edge again", 0, NLOOPS);
+
+    event_del(&et);
+    event_base_free(base);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+int
+main (int argc, char **argv)
+{
+    alarm(10);
+
+    run("epoll");
+    setenv("EVENT_NOEPOLL", "1", 1);
+    run("io_uring");
+
+    return (!test_okay);
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+#include "buffer.h"
+
+
+
+#define NOPS    20000
+#define MAXLEN  (1 << 22)
+
+int test_okay = 1;
+
+/* what the buffer should hold: model[head .. tail) */
+unsigned char *model;
+size_t head, tail;
+unsigned char next_byte;
+size_t cb_len;
+
+
+static void
+length_cb(struct evbuffer *buf, size_t old, size_t now, void *arg)
+{
+    if (old != cb_len || now != evbuffer_get_length(buf))
+        test_okay = 0;
+    cb_len = now;
+}
+
+static void
+fill(unsigned char *p, size_t len)
+{
+    while (len--)
+        *p++ = next_byte++;
+}
+
+/* Append len bytes to both the buffer and the model. */
+static void
+add(struct evbuffer *buf, size_t len)
+{
+    if (tail + len > MAXLEN) {
+        memmove(model, model + head, tail - head);
+        tail -= head;
+        head = 0;
+    }
+    fill(model + tail, len);
+    evbuffer_add(buf, model + tail, len);
+    tail += len;
+}
+
+static void
+check(struct evbuffer *buf, const char *op)
+{
+    size_t len = tail - head;
+    unsigned char *data;
+
+    if (evbuffer_get_length(buf) != len) {
+        printf("%s: after %s: length %zu, expected %zu\n", __func__, op,
+                evbuffer_get_length(buf), len);
+        test_okay = 0;
+        return;
+    }
+    data = evbuffer_pullup(buf, -1);
+    if (len && (data == NULL || memcmp(data, model + head, len) != 0)) {
+        printf("%s: after %s: contents differ\n", __func__, op);
+        test_okay = 0;
+    }
+}
+
+/* A buffer of many chunks goes out in one writev() and what the socket
+ * has queued comes back in one readv(). */
+static void
+test_io(void)
+{
+    struct evbuffer *out, *in;
+    unsigned char msg[1000], *p;
+    int pair[2], i, n;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+        test_okay = 0;
+        return;
+    }
+    out = evbuffer_new();
+    in = evbuffer_new();
+    for (i = 0; i < 64; i++) {
+        memset(msg, i, sizeof(msg));
+        evbuffer_add(out, msg, sizeof(msg));
+    }
+
+    n = evbuffer_write(out, pair[0]);
+    printf("%s: wrote %d bytes in one call\n", __func__, n);
+    if (n != 64 * (int)sizeof(msg) || evbuffer_get_length(out) != 0)
+        test_okay = 0;
+
+    /* asking for nothing reads nothing, and isn't EOF */
+    if (evbuffer_read(in, pair[1], 0) != 0 || evbuffer_get_length(in) != 0)
+        test_okay = 0;
+
+    n = evbuffer_read(in, pair[1], -1);
+    printf("%s: read %d bytes in one call\n", __func__, n);
+    if (n != 64 * (int)sizeof(msg) || evbuffer_get_length(in) != (size_t)n)
+        test_okay = 0;
+    p = evbuffer_pullup(in, -1);
+    for (i = 0; p != NULL && i < n; i++) {
+        if (p[i] != i / sizeof(msg))
+            test_okay = 0;
+    }
+
+    shutdown(pair[0], SHUT_WR);
+    if (evbuffer_read(in, pair[1], -1) != 0)
+        test_okay = 0;
+
+    evbuffer_free(out);
+    evbuffer_free(in);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+int
+main (int argc, char **argv)
+{
+    struct evbuffer *buf, *other;
+    unsigned char *out, *p;
+    size_t len, n;
+    int i;
+
+    srand(1);
+    model = malloc(MAXLEN);
+    out = malloc(MAXLEN);
+    buf = evbuffer_new();
+    other = evbuffer_new();
+    evbuffer_setcb(buf, length_cb, NULL);
+
+    for (i = 0; i < NOPS && test_okay; i++) {
+        len = tail - head;
+        switch (rand() % 6) {
+        case 0:
+        case 1:
+            /* mostly small appends, now and then one bigger than a chunk */
+            add(buf, rand() % 8 ? rand() % 2000 : rand() % 20000);
+            break;
+        case 2:
+            n = len ? rand() % (len + 1) : 0;
+            evbuffer_drain(buf, n);
+            head += n;
+            break;
+        case 3:
+            n = rand() % 3000;
+            n = evbuffer_remove(buf, out, n);
+            if (memcmp(out, model + head, n) != 0)
+                test_okay = 0;
+            head += n;
+            break;
+        case 4:
+            /* a partial pullup must leave everything else in place */
+            n = len ? rand() % (len + 1) : 0;
+            p = evbuffer_pullup(buf, n);
+            if (n && (p == NULL || memcmp(p, model + head, n) != 0))
+                test_okay = 0;
+            if (evbuffer_get_contiguous_space(buf) < n)
+                test_okay = 0;
+            if (evbuffer_pullup(buf, len + 1) != NULL)
+                test_okay = 0;
+            break;
+        case 5:
+            /* chunks handed over from another buffer */
+            n = rand() % 6000;
+            if (tail + n > MAXLEN) {
+                memmove(model, model + head, tail - head);
+                tail -= head;
+                head = 0;
+            }
+            fill(model + tail, n);
+            evbuffer_add(other, model + tail, n);
+            tail += n;
+            evbuffer_add_buffer(buf, other);
+            if (evbuffer_get_length(other) != 0)
+                test_okay = 0;
+            break;
+        }
+        if (i % 100 == 0)
+            check(buf, "op");
+    }
+    check(buf, "last op");
+    evbuffer_drain(buf, evbuffer_get_length(buf));
+    head = tail;
+    check(buf, "drain");
+
+    printf("%s: %d operations, %s\n", __func__, i,
+            test_okay ? "contents match" : "FAILED");
+
+    test_io();
+    evbuffer_free(buf);
+    evbuffer_free(other);
+    free(model);
+    free(out);
+    return (!test_okay);
+}
@@ -0,0 +1,148 @@
+/*
+ * Random push/erase/pop on the 4-ary heap.  After every operation the
+ * whole heap is checked: parent keys never above their children, each
+ * entry's key matching its event and each event's min_heap_idx pointing
+ * back at its entry.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "min_heap4.h"
+
+
+
+#define NEVENTS	512
+#define NOPS	200000
+
+int test_okay = 1;
+struct event evs[NEVENTS];
+int in_heap[NEVENTS];
+unsigned nin;
+
+
+static int
+check(min_heap4_t *h, const char *op, int round)
+{
+	unsigned i;
+
+	if (min_heap4_size(h) != nin) {
+		printf("%s: %s %d: size %u, expected %u\n", __func__, op,
+		    round, min_heap4_size(h), nin);
+		return (-1);
+	}
+	/* the four children of a node share a cache line */
+	if (((uintptr_t)&h->p[1] % MIN_HEAP4_LINE) != 0) {
+		printf("%s: %s %d: children not line aligned\n", __func__, op,
+		    round);
+		return (-1);
+	}
+	for (i = 0; i < h->n; i++) {
+		if (h->p[i].e->min_heap_idx != i ||
+		    h->p[i].deadline != min_heap4_key(&h->p[i].e->ev_timeout)) {
+			printf("%s: %s %d: entry %u stale\n", __func__, op,
+			    round, i);
+			return (-1);
+		}
+		if (i > 0 && h->p[(i - 1) / 4].deadline > h->p[i].deadline) {
+			printf("%s: %s %d: entry %u above its parent\n",
+			    __func__, op, round, i);
+			return (-1);
+		}
+	}
+	for (i = 0; i < NEVENTS; i++) {
+		if (!in_heap[i] && evs[i].min_heap_idx != (unsigned)-1) {
+			printf("%s: %s %d: event %u still indexed\n", __func__,
+			    op, round, i);
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+/* An event that is, or is not, on the heap, picked at random. */
+static struct event *
+pick(int want)
+{
+	int i = random() % NEVENTS;
+
+	while (in_heap[i] != want)
+		i = (i + 1) % NEVENTS;
+	return (&evs[i]);
+}
+
+int
+main(int argc, char **argv)
+{
+	min_heap4_t h;
+	struct event *e, *top;
+	const char *op;
+	int i, r;
+
+	srandom(5);
+	min_heap4_ctor(&h);
+	for (i = 0; i < NEVENTS; i++)
+		evs[i].min_heap_idx = -1;
+
+	for (r = 0; r < NOPS && test_okay; r++) {
+		/* grow until every event is queued, then churn */
+		i = random() % 8;
+		if (nin == 0 || (nin < NEVENTS && i < 4)) {
+			op = "push";
+			e = pick(0);
+			/* few distinct keys, so ties are common */
+			e->ev_timeout.tv_sec = random() % 64;
+			e->ev_timeout.tv_usec = random() % 4 * 250000;
+			if (min_heap4_push(&h, e) == -1) {
+				test_okay = 0;
+				break;
+			}
+			in_heap[e - evs] = 1;
+			nin++;
+		} else if (i < 6) {
+			/* from anywhere, mostly the middle where it has to move */
+			op = "erase";
+			e = pick(1);
+			if (min_heap4_erase(&h, e) == -1 ||
+			    min_heap4_erase(&h, e) != -1)
+				test_okay = 0;
+			in_heap[e - evs] = 0;
+			nin--;
+		} else {
+			op = "pop";
+			top = min_heap4_top(&h);
+			e = min_heap4_pop(&h);
+			if (e != top) {
+				printf("%s: pop %d: not the top\n", __func__, r);
+				test_okay = 0;
+			}
+			in_heap[e - evs] = 0;
+			nin--;
+			/* nothing left may be due before it */
+			if (h.n && min_heap4_key(&e->ev_timeout) >
+			    h.p[0].deadline) {
+				printf("%s: pop %d: not the minimum\n", __func__,
+				    r);
+				test_okay = 0;
+			}
+		}
+		if (check(&h, op, r) == -1)
+			test_okay = 0;
+	}
+
+	/* draining must come out sorted */
+	while ((e = min_heap4_pop(&h)) != NULL) {
+		in_heap[e - evs] = 0;
+		nin--;
+		if (h.n && min_heap4_key(&e->ev_timeout) > h.p[0].deadline)
+			test_okay = 0;
+		if (check(&h, "drain", r++) == -1)
+			test_okay = 0;
+	}
+
+	printf("%s: %d operations\n", __func__, r);
+	min_heap4_dtor(&h);
+	return (!test_okay);
+}
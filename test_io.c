@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+int test_okay = 1;
+int called = 0;
+char rbuf[64];
+const char *test = "test string";
+
+
+static void
+write_done(int fd, ssize_t res, void *arg)
+{
+    if (res != (ssize_t)strlen(test) + 1)
+        test_okay = 0;
+    called++;
+}
+
+static void
+read_done(int fd, ssize_t res, void *arg)
+{
+    printf("%s: read %zd: %s\n", __func__, res, res > 0 ? rbuf : "");
+    if (res != (ssize_t)strlen(test) + 1 || strcmp(rbuf, test) != 0)
+        test_okay = 0;
+    called++;
+}
+
+/* Read before anything is written, so the read has to wait for it. */
+static void
+run(const char *method)
+{
+    struct event_base *base;
+    struct iovec iov;
+    int pair[2];
+
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+        test_okay = 0;
+        return;
+    }
+    if ((base = event_base_new()) == NULL) {
+        test_okay = 0;
+        return;
+    }
+    printf("%s: %s\n", __func__, event_base_get_method(base));
+    if (strcmp(event_base_get_method(base), method) != 0) {
+        /* backend not available here */
+        event_base_free(base);
+        return;
+    }
+
+    if (strcmp(method, "io_uring") == 0) {
+        iov.iov_base = rbuf;
+        iov.iov_len = sizeof(rbuf);
+        if (event_base_register_buffers(base, &iov, 1) == -1 ||
+                event_base_register_fd(base, pair[1]) == -1)
+            test_okay = 0;
+        /* more than an SQE's 32-bit length is refused, not truncated */
+        if (event_base_read(base, pair[1], rbuf, (size_t)UINT32_MAX + 1,
+                    read_done, NULL) != -1 || errno != EINVAL)
+            test_okay = 0;
+    }
+
+    memset(rbuf, 0, sizeof(rbuf));
+    called = 0;
+    if (event_base_read(base, pair[1], rbuf, sizeof(rbuf), read_done,
+                NULL) == -1 ||
+            event_base_write(base, pair[0], test, strlen(test) + 1,
+                write_done, NULL) == -1)
+        test_okay = 0;
+
+    /* returns once both callbacks have run */
+    event_base_loop(base, 0);
+    if (called != 2)
+        test_okay = 0;
+
+    if (strcmp(method, "io_uring") == 0)
+        event_base_unregister_fd(base, pair[1]);
+    event_base_free(base);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+int
+main (int argc, char **argv)
+{
+    alarm(10);
+
+    run("epoll");
+    setenv("EVENT_NOEPOLL", "1", 1);
+    run("io_uring");
+
+    return (!test_okay);
+}
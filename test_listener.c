@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+#include "event.h"
+#include "listener.h"
+
+
+
+#define NCLIENTS    10
+#define BUDGET      4
+
+int test_okay = 1;
+int accepted = 0;
+
+
+static void
+accept_cb(struct evconnlistener *lev, int fd, struct sockaddr *sa,
+        socklen_t salen, void *arg)
+{
+    if (!(fcntl(fd, F_GETFL) & O_NONBLOCK) ||
+            !(fcntl(fd, F_GETFD) & FD_CLOEXEC) ||
+            sa->sa_family != AF_INET)
+        test_okay = 0;
+    close(fd);
+    accepted++;
+}
+
+static void
+connect_clients(struct sockaddr_in *sin, int *fds)
+{
+    int i;
+
+    for (i = 0; i < NCLIENTS; i++) {
+        if ((fds[i] = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+                connect(fds[i], (struct sockaddr *)sin, sizeof(*sin)) == -1)
+            test_okay = 0;
+    }
+}
+
+static void
+close_clients(int *fds)
+{
+    int i;
+
+    for (i = 0; i < NCLIENTS; i++)
+        close(fds[i]);
+}
+
+static void
+wait_accepted(struct event_base *base, int n)
+{
+    while (test_okay && accepted < n)
+        event_base_loop(base, EVLOOP_ONCE);
+}
+
+int
+main (int argc, char **argv)
+{
+    struct event_base *base;
+    struct evconnlistener *lev;
+    struct event_base_stats stats;
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    struct timeval pause = { 0, 50000 };
+    struct rlimit rl, low;
+    int fds[NCLIENTS], i;
+
+    alarm(10);
+
+    base = event_base_new();
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    lev = evconnlistener_new_bind(base, accept_cb, NULL, 0, 0,
+            (struct sockaddr *)&sin, sizeof(sin));
+    if (lev == NULL ||
+            getsockname(evconnlistener_get_fd(lev), (struct sockaddr *)&sin,
+                &len) == -1)
+        return (1);
+    evconnlistener_set_budget(lev, BUDGET);
+    evconnlistener_set_pause(lev, &pause);
+
+    /* a storm of connections is taken BUDGET at a time */
+    connect_clients(&sin, fds);
+    event_base_loop(base, EVLOOP_ONCE);
+    printf("%s: %d accepted in the first wakeup\n", __func__, accepted);
+    if (accepted != BUDGET)
+        test_okay = 0;
+    wait_accepted(base, NCLIENTS);
+    close_clients(fds);
+
+    /* out of descriptors: the listener must pause, not spin */
+    connect_clients(&sin, fds);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    low = rl;
+    low.rlim_cur = dup(0);
+    close(low.rlim_cur);
+    setrlimit(RLIMIT_NOFILE, &low);
+
+    accepted = 0;
+    event_base_enable_stats(base, 1);
+    for (i = 0; i < 10; i++)
+        event_base_loop(base, EVLOOP_NONBLOCK);
+    event_base_get_stats(base, &stats);
+    printf("%s: %lu callbacks while out of descriptors\n", __func__,
+            stats.callbacks);
+    if (accepted != 0 || stats.callbacks != 1)
+        test_okay = 0;
+
+    /* once descriptors are back, the pause ends and the rest go through */
+    setrlimit(RLIMIT_NOFILE, &rl);
+    wait_accepted(base, NCLIENTS);
+    printf("%s: %d accepted after the pause\n", __func__, accepted);
+    close_clients(fds);
+
+    evconnlistener_free(lev);
+    event_base_free(base);
+    return (!test_okay);
+}
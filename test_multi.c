@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+int test_okay = 1;
+int called[2];
+
+
+static void
+read_cb(int fd, short event, void *arg)
+{
+    called[(intptr_t)arg]++;
+}
+
+static void
+write_cb(int fd, short event, void *arg)
+{
+}
+
+static int
+add(struct event *ev)
+{
+    return (event_add(ev, NULL));
+}
+
+static int
+del(struct event *ev)
+{
+    return (event_del(ev));
+}
+
+/* Check that f(ev) made n epoll_ctl calls; io_uring defers them to its
+ * dispatch, so n is 0 there. */
+static void
+expect(struct event_base *base, int (*f)(struct event *), struct event *ev,
+        unsigned long n)
+{
+    unsigned long before = event_base_get_backend_syscalls(base);
+
+    f(ev);
+    if (event_base_get_backend_syscalls(base) - before != n) {
+        printf("%s: %lu backend syscalls, expected %lu\n", __func__,
+                event_base_get_backend_syscalls(base) - before, n);
+        test_okay = 0;
+    }
+}
+
+/* Two readers and a writer on one fd: both readers see the data, and
+ * only changes to the combined interest reach the kernel.  flags go on
+ * the first reader; an exclusive fd needs a delete and an add to change
+ * its interest. */
+static void
+run(const char *method, short flags)
+{
+    struct event_base *base;
+    struct event rd[2], wr;
+    int pair[2], i, epoll, mod;
+
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+        test_okay = 0;
+        return;
+    }
+    if ((base = event_base_new()) == NULL) {
+        test_okay = 0;
+        return;
+    }
+    printf("%s: %s\n", __func__, event_base_get_method(base));
+    if (strcmp(event_base_get_method(base), method) != 0) {
+        /* backend not available here */
+        event_base_free(base);
+        return;
+    }
+    epoll = strcmp(method, "epoll") == 0 &&
+        !evutil_getenv("EVENT_EPOLL_USE_CHANGELIST");
+    mod = (flags & EV_EXCLUSIVE) ? 2 * epoll : epoll;
+
+    for (i = 0; i < 2; i++) {
+        event_set(&rd[i], pair[1], EV_READ | EV_PERSIST | (i ? 0 : flags),
+                read_cb, (void *)(intptr_t)i);
+        event_base_set(base, &rd[i]);
+    }
+    event_set(&wr, pair[1], EV_WRITE, write_cb, NULL);
+    event_base_set(base, &wr);
+
+    expect(base, add, &rd[0], epoll);
+    expect(base, add, &rd[1], 0);
+    expect(base, add, &wr, mod);
+    expect(base, del, &wr, mod);
+
+    called[0] = called[1] = 0;
+    write(pair[0], "x", 1);
+    event_base_loop(base, EVLOOP_ONCE);
+    printf("%s: readers called %d, %d\n", __func__, called[0], called[1]);
+    if (called[0] != 1 || called[1] != 1)
+        test_okay = 0;
+
+    /* the fd stays registered while one reader is left */
+    expect(base, del, &rd[1], 0);
+    expect(base, del, &rd[0], epoll);
+
+    event_base_free(base);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+int
+main (int argc, char **argv)
+{
+    alarm(10);
+
+    run("epoll", 0);
+    run("epoll", EV_EXCLUSIVE);
+    setenv("EVENT_NOEPOLL", "1", 1);
+    run("io_uring", 0);
+
+    return (!test_okay);
+}
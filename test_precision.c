@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+#define NROUNDS	500
+#define PERIOD_USEC	200
+
+int called = 0;
+long total_late = 0, max_late = 0;
+struct timeval deadline;
+
+
+static void
+now_tv(struct timeval *tv)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+}
+
+static void
+schedule(struct event *ev)
+{
+	struct timeval tv = {0, PERIOD_USEC};
+
+	now_tv(&deadline);
+	evutil_timeradd(&deadline, &tv, &deadline);
+	evtimer_add(ev, &tv);
+}
+
+static void
+time_cb(int fd, short event, void *arg)
+{
+	struct timeval now;
+	long late;
+
+	now_tv(&now);
+	late = (now.tv_sec - deadline.tv_sec) * 1000000L +
+	    (now.tv_usec - deadline.tv_usec);
+	total_late += late;
+	if (late > max_late)
+		max_late = late;
+
+	if (++called < NROUNDS)
+		schedule(arg);
+}
+
+/* Mean lateness of NROUNDS back to back timers on a fresh base; *nsys
+ * gets the backend syscalls they took. */
+static long
+run(const char *mode, unsigned long *nsys)
+{
+	struct event_base *base;
+	struct event ev;
+	long mean;
+
+	called = 0;
+	total_late = max_late = 0;
+	base = event_base_new();
+	evtimer_set(&ev, time_cb, &ev);
+	event_base_set(base, &ev);
+	schedule(&ev);
+	event_base_loop(base, 0);
+	*nsys = event_base_get_backend_syscalls(base);
+	event_base_free(base);
+
+	mean = total_late / called;
+	printf("%s: %s: %d timers of %dus: mean lateness %ldus, max %ldus, "
+	    "%lu syscalls\n", __func__, mode, called, PERIOD_USEC, mean,
+	    max_late, *nsys);
+	return (mean);
+}
+
+int
+main(int argc, char **argv)
+{
+	long rounded, pwait2, timerfd;
+	unsigned long nsys;
+
+	alarm(20);
+
+	/* the baseline: every wait rounded up to whole milliseconds */
+	unsetenv("EVENT_EPOLL_NOPWAIT2");
+	setenv("EVENT_EPOLL_NOHIRES", "1", 1);
+	rounded = run("ms", &nsys);
+	unsetenv("EVENT_EPOLL_NOHIRES");
+	pwait2 = run("hires", &nsys);
+	setenv("EVENT_EPOLL_NOPWAIT2", "1", 1);
+	timerfd = run("timerfd", &nsys);
+	unsetenv("EVENT_EPOLL_NOPWAIT2");
+
+	/* every timerfd wait arms it first */
+	if (nsys < 2 * NROUNDS)
+		return (1);
+
+	/* relative to the baseline, so a loaded machine slows both alike */
+	return (pwait2 * 2 < rounded && timerfd * 2 < rounded ? 0 : 1);
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+
+#include "event.h"
+
+
+
+#define NBASES	2
+
+int test_okay = 1;
+pthread_barrier_t ready;
+
+struct reactor {
+    pthread_t thread;
+    int own_signal;     /* only this base watches it */
+    int own_called;
+    int hup_called;     /* every base watches SIGHUP */
+};
+
+
+static void
+signal_cb(int fd, short event, void *arg)
+{
+    struct reactor *r = arg;
+
+    if (!pthread_equal(pthread_self(), r->thread))
+        test_okay = 0;
+    if (fd == SIGHUP)
+        r->hup_called++;
+    else if (fd == r->own_signal)
+        r->own_called++;
+    else
+        test_okay = 0;
+}
+
+static void *
+reactor_thread(void *arg)
+{
+    struct reactor *r = arg;
+    struct event_base *base;
+    struct event own, hup;
+
+    base = event_base_new();
+    event_set(&own, r->own_signal, EV_SIGNAL, signal_cb, r);
+    event_base_set(base, &own);
+    event_add(&own, NULL);
+    event_set(&hup, SIGHUP, EV_SIGNAL, signal_cb, r);
+    event_base_set(base, &hup);
+    event_add(&hup, NULL);
+
+    pthread_barrier_wait(&ready);
+
+    /* returns once both one-shot signal events have fired */
+    event_base_loop(base, 0);
+    event_base_free(base);
+    return (NULL);
+}
+
+/* Every base gets its own signal and SIGHUP, read the way mode says. */
+static void
+run(const char *mode)
+{
+    struct reactor reactors[NBASES] = {
+        { .own_signal = SIGUSR1 },
+        { .own_signal = SIGUSR2 },
+    };
+    int i;
+
+    pthread_barrier_init(&ready, NULL, NBASES + 1);
+    for (i = 0; i < NBASES; i++)
+        pthread_create(&reactors[i].thread, NULL, reactor_thread,
+                &reactors[i]);
+    pthread_barrier_wait(&ready);
+
+    kill(getpid(), SIGUSR1);
+    kill(getpid(), SIGUSR2);
+    kill(getpid(), SIGHUP);
+
+    for (i = 0; i < NBASES; i++) {
+        pthread_join(reactors[i].thread, NULL);
+        printf("%s: %s: base %d: own signal %d, SIGHUP %d\n", __func__,
+                mode, i, reactors[i].own_called, reactors[i].hup_called);
+        if (reactors[i].own_called != 1 || reactors[i].hup_called != 1)
+            test_okay = 0;
+    }
+    pthread_barrier_destroy(&ready);
+}
+
+int
+main (int argc, char **argv)
+{
+    sigset_t set;
+
+    alarm(10);
+
+    unsetenv("EVENT_USE_SIGNALFD");
+    run("sigaction");
+    /* the first base to watch a signal reads it from its signalfd; this
+     * thread has them unblocked, so the handler gets them instead */
+    setenv("EVENT_USE_SIGNALFD", "1", 1);
+    run("signalfd");
+    /* blocked in every thread, only the signalfd sees them and its owner
+     * passes SIGHUP on to the other base */
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    run("signalfd, blocked");
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+    return (!test_okay);
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+#include "event.h"
+
+
+
+int test_okay = 1;
+int called = 0;
+
+
+static void
+signal_cb(int fd, short event, void *arg)
+{
+    called++;
+}
+
+static void
+raise_cb(int fd, short event, void *arg)
+{
+    kill(getpid(), SIGUSR1);
+}
+
+/* A signal raised from inside the loop must reach the signal event. */
+static void
+run(const char *mode)
+{
+    struct event_base *base;
+    struct event sigev, timer;
+    struct timeval tv = {0, 10000};
+
+    if ((base = event_base_new()) == NULL) {
+        test_okay = 0;
+        return;
+    }
+
+    called = 0;
+    event_set(&sigev, SIGUSR1, EV_SIGNAL, signal_cb, NULL);
+    event_base_set(base, &sigev);
+    event_add(&sigev, NULL);
+    evtimer_set(&timer, raise_cb, NULL);
+    event_base_set(base, &timer);
+    evtimer_add(&timer, &tv);
+
+    /* returns once the one-shot signal event has fired */
+    event_base_loop(base, 0);
+    printf("%s: %s: signal callback ran %d time(s)\n", __func__, mode,
+            called);
+    if (called != 1)
+        test_okay = 0;
+
+    event_base_free(base);
+}
+
+int
+main (int argc, char **argv)
+{
+    alarm(10);
+
+    run("sigaction");
+    setenv("EVENT_USE_SIGNALFD", "1", 1);
+    run("signalfd");
+
+    return (!test_okay);
+}
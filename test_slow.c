@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+#include "event.h"
+
+
+
+#define NFAST	100
+
+int test_okay = 1;
+int reported = 0;
+int reported_fd = -1;
+
+
+static void
+fast_cb(int fd, short event, void *arg)
+{
+}
+
+static void
+slow_cb(int fd, short event, void *arg)
+{
+    usleep(20000);
+}
+
+static void
+report(void (*callback)(int, short, void *), int fd, short what,
+        uint64_t nsec, void *arg)
+{
+    printf("%s: callback %p on fd %d took %llu us\n", __func__,
+            (void *)callback, fd, (unsigned long long)nsec / 1000);
+    if (callback != slow_cb || what != EV_TIMEOUT)
+        test_okay = 0;
+    reported_fd = fd;
+    reported++;
+}
+
+int
+main (int argc, char **argv)
+{
+    struct event_base *base;
+    struct event fast[NFAST], slow;
+    struct event_callback_total totals[4];
+    struct timeval threshold = {0, 5000}, tv = {0, 1000};
+    int i, n;
+
+    base = event_base_new();
+    event_base_set_slow_callback(base, &threshold, report, NULL);
+
+    for (i = 0; i < NFAST; i++) {
+        evtimer_set(&fast[i], fast_cb, NULL);
+        event_base_set(base, &fast[i]);
+        evtimer_add(&fast[i], &tv);
+    }
+    evtimer_set(&slow, slow_cb, NULL);
+    event_base_set(base, &slow);
+    evtimer_add(&slow, &tv);
+
+    event_base_loop(base, 0);
+
+    if (reported != 1 || reported_fd != -1)
+        test_okay = 0;
+
+    /* the slow handler leads the totals despite running once */
+    n = event_base_get_callback_totals(base, totals, 4);
+    for (i = 0; i < n; i++)
+        printf("%s: %p: %lu calls, %lu slow, %llu us total\n", __func__,
+                (void *)totals[i].callback, totals[i].calls, totals[i].slow,
+                (unsigned long long)totals[i].nsec / 1000);
+    if (n != 2 || totals[0].callback != slow_cb || totals[0].slow != 1 ||
+            totals[1].callback != fast_cb || totals[1].calls != NFAST ||
+            totals[1].slow != 0)
+        test_okay = 0;
+
+    event_base_set_slow_callback(base, NULL, NULL, NULL);
+    if (event_base_get_callback_totals(base, totals, 4) != -1)
+        test_okay = 0;
+
+    event_base_free(base);
+    return (!test_okay);
+}
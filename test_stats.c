@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+#define NTIMERS	10
+
+int test_okay = 1;
+int called = 0;
+
+
+static void
+timer_cb(int fd, short event, void *arg)
+{
+    called++;
+}
+
+static void
+read_cb(int fd, short event, void *arg)
+{
+    char buf[16];
+
+    if (recv(fd, buf, sizeof(buf), 0) > 0)
+        called++;
+}
+
+int
+main (int argc, char **argv)
+{
+    struct event_base *base;
+    struct event timers[NTIMERS], rev;
+    struct event_base_stats st;
+    struct timeval tv;
+    unsigned long nhist;
+    int i, pair[2];
+
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+        return (1);
+
+    base = event_base_new();
+    if (event_base_get_stats(base, &st) != -1)
+        test_okay = 0;
+    event_base_enable_stats(base, 1);
+
+    for (i = 0; i < NTIMERS; i++) {
+        tv.tv_sec = 0;
+        tv.tv_usec = 1000 * (i + 1);
+        evtimer_set(&timers[i], timer_cb, NULL);
+        event_base_set(base, &timers[i]);
+        evtimer_add(&timers[i], &tv);
+    }
+    event_set(&rev, pair[1], EV_READ, read_cb, NULL);
+    event_base_set(base, &rev);
+    event_add(&rev, NULL);
+    send(pair[0], "x", 1, 0);
+
+    event_base_loop(base, 0);
+
+    event_base_get_stats(base, &st);
+    printf("%s: %lu loops, %lu waits returning %lu events, "
+            "%lu callbacks, %u timers at most\n", __func__, st.loops,
+            st.dispatches, st.events_returned, st.callbacks, st.timers_max);
+    printf("%s: %llu ns blocked, %llu ns in callbacks\n", __func__,
+            (unsigned long long)st.nsec_blocked,
+            (unsigned long long)st.nsec_callbacks);
+
+    if (st.callbacks != NTIMERS + 1 || called != NTIMERS + 1)
+        test_okay = 0;
+    if (st.dispatches == 0 || st.dispatches > st.loops)
+        test_okay = 0;
+    if (st.events_returned < 1 || st.timers_max != NTIMERS)
+        test_okay = 0;
+    for (i = 0, nhist = 0; i < EVENT_STATS_NBUCKETS; i++)
+        nhist += st.hist_callback[i];
+    if (nhist != st.callbacks)
+        test_okay = 0;
+
+    event_base_reset_stats(base);
+    event_base_get_stats(base, &st);
+    if (st.loops || st.callbacks || st.nsec_blocked)
+        test_okay = 0;
+
+    event_base_free(base);
+    return (!test_okay);
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+
+#include "event.h"
+#include "evutil.h"
+
+
+
+int test_okay = 1;
+int called = 0;
+pthread_t loop_thread;
+struct event ev_idle, ev_work;
+
+
+static void
+idle_cb(int fd, short event, void *arg)
+{
+    /* nobody writes to the pair */
+    test_okay = 0;
+}
+
+static void
+work_cb(int fd, short event, void *arg)
+{
+    /* must run on the loop thread, not the worker that activated it */
+    if (!pthread_equal(pthread_self(), loop_thread))
+        test_okay = 0;
+    called++;
+}
+
+static void *
+worker(void *arg)
+{
+    /* give the loop time to block in epoll_wait */
+    usleep(100000);
+    event_active(&ev_work, EV_TIMEOUT, 1);
+    /* drop the only registered event so the loop can return */
+    event_del(&ev_idle);
+    return (NULL);
+}
+
+int
+main (int argc, char **argv)
+{
+    struct event_base *base;
+    pthread_t th;
+    int pair[2];
+
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+        return (1);
+
+    /* fail instead of hanging if the wakeup never arrives */
+    alarm(5);
+
+    base = event_init();
+    if (event_base_use_threads(base) == -1)
+        return (1);
+
+    event_set(&ev_idle, pair[1], EV_READ | EV_PERSIST, idle_cb, NULL);
+    event_add(&ev_idle, NULL);
+    evtimer_set(&ev_work, work_cb, NULL);
+
+    loop_thread = pthread_self();
+    pthread_create(&th, NULL, worker, NULL);
+
+    event_dispatch();
+    pthread_join(th, NULL);
+
+    printf("%s: work callback ran %d time(s)\n", __func__, called);
+    if (called != 1)
+        test_okay = 0;
+    return (!test_okay);
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+
+#include "event.h"
+#include "threadpool.h"
+
+
+
+#define NJOBS	1000
+
+int test_okay = 1;
+int called = 0;
+pthread_t loop_thread;
+struct evthreadpool *pool;
+long results[NJOBS];
+
+
+static void
+work(void *arg)
+{
+    long *r = arg;
+    long i, n = (r - results) % 7 == 0 ? 200000 : 1000;
+
+    /* uneven job sizes so idle workers have something to steal */
+    for (i = 0; i < n; i++)
+        *r += i & 1;
+}
+
+static void
+done(void *arg)
+{
+    if (!pthread_equal(pthread_self(), loop_thread))
+        test_okay = 0;
+    called++;
+}
+
+static void
+count(void *arg)
+{
+    __atomic_add_fetch((int *)arg, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Free a pool whose jobs have all finished but whose done callbacks are
+ * still active on the base, then run the loop again: none of them may
+ * run and the loop must see nothing left to wait for.
+ */
+static void
+free_with_completions(struct event_base *base)
+{
+    int i, nworked = 0;
+
+    if ((pool = evthreadpool_new(base, 2)) == NULL) {
+        test_okay = 0;
+        return;
+    }
+    called = 0;
+    for (i = 0; i < NJOBS / 10; i++)
+        if (evthreadpool_submit(pool, count, done, &nworked) == -1)
+            test_okay = 0;
+    while (__atomic_load_n(&nworked, __ATOMIC_SEQ_CST) < NJOBS / 10)
+        usleep(1000);
+    evthreadpool_free(pool);
+
+    event_base_loop(base, 0);
+    printf("%s: %d done callbacks after free\n", __func__, called);
+    if (called != 0)
+        test_okay = 0;
+}
+
+static void
+submit_cb(int fd, short event, void *arg)
+{
+    int i;
+
+    for (i = 0; i < NJOBS; i++)
+        if (evthreadpool_submit(pool, work, done, &results[i]) == -1)
+            test_okay = 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    struct event_base *base;
+    struct event ev;
+    struct timeval tv = {0, 0};
+    int i;
+
+    alarm(20);
+
+    base = event_init();
+    if ((pool = evthreadpool_new(base, 4)) == NULL)
+        return (1);
+    loop_thread = pthread_self();
+
+    evtimer_set(&ev, submit_cb, NULL);
+    evtimer_add(&ev, &tv);
+
+    /* returns once every done callback has run */
+    event_dispatch();
+    evthreadpool_free(pool);
+
+    for (i = 0; i < NJOBS; i++)
+        if (results[i] != ((i % 7 == 0) ? 100000 : 500))
+            test_okay = 0;
+
+    printf("%s: %d of %d jobs completed\n", __func__, called, NJOBS);
+    if (called != NJOBS)
+        test_okay = 0;
+
+    free_with_completions(base);
+    return (!test_okay);
+}
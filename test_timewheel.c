@@ -0,0 +1,150 @@
+/*
+ * Drives the timing wheel on a simulated clock, the way the loop does:
+ * sleep for timewheel_next_timeout(), advance, run what expired.  Timers
+ * span every level up to 2^31 ms; none may fire before its deadline or a
+ * tick after it, and they must fire in deadline order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "evutil.h"
+#include "timewheel.h"
+
+
+
+#define NRANDOM		2000
+#define MAX_DELTA_MS	((uint64_t)1 << 31)
+#define MAX_ROUNDS	1000000
+
+int test_okay = 1;
+
+
+static uint64_t
+tv_to_usec(const struct timeval *tv)
+{
+	return ((uint64_t)tv->tv_sec * 1000000 + tv->tv_usec);
+}
+
+static void
+usec_to_tv(uint64_t usec, struct timeval *tv)
+{
+	tv->tv_sec = usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+/* The tick a deadline is due in, rounded up like the wheel does. */
+static uint64_t
+tick_of(const struct timeval *tv)
+{
+	return ((tv_to_usec(tv) + TW_TICK_USEC - 1) / TW_TICK_USEC);
+}
+
+static uint64_t
+rand_below(uint64_t n)
+{
+	return ((((uint64_t)random() << 31) | random()) % n);
+}
+
+int
+main(int argc, char **argv)
+{
+	/* a level boundary and its neighbours, for every level */
+	static const uint64_t edges[] = {
+		1, 255, 256, 257, (1 << 14) - 1, 1 << 14, (1 << 14) + 1,
+		(1 << 20) - 1, 1 << 20, (1 << 20) + 1, (1 << 26) - 1, 1 << 26,
+		(1 << 26) + 1, MAX_DELTA_MS - 1, MAX_DELTA_MS
+	};
+	int nedges = sizeof(edges) / sizeof(edges[0]);
+	int n = nedges + NRANDOM, nfired = 0, ndeleted = 0, rounds = 0, i;
+	struct event *evs, *ev;
+	struct timewheel *tw;
+	struct timeval now, tv;
+	uint64_t start, usec, last = 0, delta;
+	int *fired;
+
+	srandom(7);
+	evs = calloc(n, sizeof(struct event));
+	fired = calloc(n, sizeof(int));
+
+	/* not tick aligned, so deadlines land mid-tick */
+	usec = start = (uint64_t)1700000000 * 1000000 + 123456;
+	usec_to_tv(usec, &now);
+	tw = timewheel_new(&now);
+
+	for (i = 0; i < n; i++) {
+		if (i < nedges)
+			delta = edges[i] * 1000;
+		else	/* spread evenly over the levels, not over the range */
+			delta = rand_below((uint64_t)1000 <<
+			    (8 + rand_below(24))) + 1;
+		if (delta > MAX_DELTA_MS * 1000)
+			delta = MAX_DELTA_MS * 1000;
+		usec_to_tv(start + delta, &evs[i].ev_timeout);
+		timewheel_add(tw, &evs[i]);
+	}
+	/* cancelled timers must never come back */
+	for (i = 0; i < n; i += 7) {
+		timewheel_del(tw, &evs[i]);
+		fired[i] = -1;
+		ndeleted++;
+	}
+
+	while (timewheel_size(tw) > 0) {
+		if (++rounds > MAX_ROUNDS) {
+			printf("%s: no progress after %d rounds\n", __func__,
+			    rounds);
+			test_okay = 0;
+			break;
+		}
+		if (timewheel_next_timeout(tw, &now, &tv) == 1)
+			break;
+		usec += tv_to_usec(&tv);
+		usec_to_tv(usec, &now);
+
+		timewheel_advance(tw, &now);
+		while ((ev = timewheel_first_expired(tw)) != NULL) {
+			timewheel_del(tw, ev);
+			i = ev - evs;
+			if (fired[i]) {
+				printf("%s: timer %d fired again or after "
+				    "cancel\n", __func__, i);
+				test_okay = 0;
+			}
+			fired[i] = 1;
+			nfired++;
+
+			if (tv_to_usec(&ev->ev_timeout) > usec) {
+				printf("%s: timer %d fired %llu us early\n",
+				    __func__, i, (unsigned long long)
+				    (tv_to_usec(&ev->ev_timeout) - usec));
+				test_okay = 0;
+			} else if (usec - tv_to_usec(&ev->ev_timeout) >=
+			    TW_TICK_USEC) {
+				printf("%s: timer %d fired %llu us late\n",
+				    __func__, i, (unsigned long long)
+				    (usec - tv_to_usec(&ev->ev_timeout)));
+				test_okay = 0;
+			}
+			/* within a tick the wheel keeps no order */
+			if (tick_of(&ev->ev_timeout) < last) {
+				printf("%s: timer %d out of order\n", __func__, i);
+				test_okay = 0;
+			}
+			last = tick_of(&ev->ev_timeout);
+		}
+	}
+
+	printf("%s: %d fired, %d cancelled, %d wakeups over %llu ms\n",
+	    __func__, nfired, ndeleted, rounds,
+	    (unsigned long long)((usec - start) / 1000));
+	if (nfired + ndeleted != n)
+		test_okay = 0;
+
+	timewheel_free(tw);
+	free(fired);
+	free(evs);
+	return (!test_okay);
+}
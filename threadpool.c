@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "event-internal.h"
+#include "log.h"
+#include "threadpool.h"
+
+struct evjob {
+	struct event ev;		/* activated on the base when done */
+	void (*work)(void *);
+	void (*done)(void *);
+	void *arg;
+	struct evthreadpool *pool;
+	TAILQ_ENTRY (evjob) next;
+};
+
+/* Owner pushes and pops at the bottom, thieves take from the top. */
+struct evdeque {
+	pthread_mutex_t lock;
+	struct evjob **jobs;
+	unsigned top, bottom;	/* free-running, masked by size - 1 */
+	unsigned size;
+};
+
+struct evworker {
+	struct evthreadpool *pool;
+	struct evdeque dq;
+	pthread_t thread;
+	int idx;
+};
+
+struct evthreadpool {
+	struct event_base *base;
+	struct evworker *workers;
+	int nworkers;
+	unsigned next;		/* round-robin submission target */
+
+	pthread_mutex_t lock;	/* protects sleeping on cond */
+	pthread_cond_t cond;
+	int queued;		/* jobs sitting in deques */
+	int shutdown;
+
+	/* submitted, done not yet run; under the base lock */
+	TAILQ_HEAD (evjobq, evjob) pending;
+};
+
+#define EVDEQUE_INITIAL	64
+
+
+static int
+evdeque_push(struct evdeque *dq, struct evjob *job)
+{
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom - dq->top == dq->size) {
+		unsigned nsize = dq->size * 2, i;
+		struct evjob **jobs = malloc(nsize * sizeof(*jobs));
+
+		if (jobs == NULL) {
+			pthread_mutex_unlock(&dq->lock);
+			return (-1);
+		}
+		for (i = dq->top; i != dq->bottom; i++)
+			jobs[i & (nsize - 1)] = dq->jobs[i & (dq->size - 1)];
+		free(dq->jobs);
+		dq->jobs = jobs;
+		dq->size = nsize;
+	}
+	dq->jobs[dq->bottom++ & (dq->size - 1)] = job;
+	pthread_mutex_unlock(&dq->lock);
+	return (0);
+}
+
+static struct evjob *
+evdeque_pop(struct evdeque *dq)
+{
+	struct evjob *job = NULL;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom != dq->top)
+		job = dq->jobs[--dq->bottom & (dq->size - 1)];
+	pthread_mutex_unlock(&dq->lock);
+	return (job);
+}
+
+static struct evjob *
+evdeque_steal(struct evdeque *dq, int wait)
+{
+	struct evjob *job = NULL;
+
+	/* unless told to wait, don't queue up behind the owner */
+	if (wait)
+		pthread_mutex_lock(&dq->lock);
+	else if (pthread_mutex_trylock(&dq->lock) != 0)
+		return (NULL);
+	if (dq->bottom != dq->top)
+		job = dq->jobs[dq->top++ & (dq->size - 1)];
+	pthread_mutex_unlock(&dq->lock);
+	return (job);
+}
+
+static struct evjob *
+evworker_next_job(struct evworker *w, int wait)
+{
+	struct evthreadpool *pool = w->pool;
+	struct evjob *job;
+	int i;
+
+	if ((job = evdeque_pop(&w->dq)) != NULL)
+		return (job);
+	for (i = 1; i < pool->nworkers; i++) {
+		job = evdeque_steal(&pool->workers[(w->idx + i) %
+		    pool->nworkers].dq, wait);
+		if (job != NULL)
+			return (job);
+	}
+	return (NULL);
+}
+
+static void *
+evworker_thread(void *arg)
+{
+	struct evworker *w = arg;
+	struct evthreadpool *pool = w->pool;
+	struct evjob *job;
+	int wait = 0;
+
+	for (;;) {
+		if ((job = evworker_next_job(w, wait)) != NULL) {
+			wait = 0;
+			__atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+			(*job->work)(job->arg);
+			/* hand the completion back to the loop thread */
+			event_active(&job->ev, EV_TIMEOUT, 1);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->shutdown &&
+		    __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->shutdown) {
+			pthread_mutex_unlock(&pool->lock);
+			return (NULL);
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		/*
+		 * Jobs are queued but this round found none.  Rather than spin
+		 * on trylock, block on the victims' locks next round; if even
+		 * that misses, the job was just taken and the count will drop.
+		 */
+		if (wait)
+			sched_yield();
+		wait = 1;
+	}
+}
+
+static void
+evjob_done(int fd, short what, void *arg)
+{
+	struct evjob *job = arg;
+	struct evthreadpool *pool = job->pool;
+
+	EVBASE_ACQUIRE_LOCK(pool->base);
+	TAILQ_REMOVE(&pool->pending, job, next);
+	pool->base->n_pending_jobs--;
+	EVBASE_RELEASE_LOCK(pool->base);
+
+	if (job->done != NULL)
+		(*job->done)(job->arg);
+	free(job);
+}
+
+/* Stops and joins the first nthreads workers and frees the pool. */
+static void
+evthreadpool_destroy(struct evthreadpool *pool, int nthreads)
+{
+	struct evjob *job;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	for (i = 0; i < pool->nworkers; i++) {
+		free(pool->workers[i].dq.jobs);
+		pthread_mutex_destroy(&pool->workers[i].dq.lock);
+	}
+	/*
+	 * With the workers gone every pending job is either still queued or
+	 * finished with its completion active on the base; take the latter
+	 * off the active queue so evjob_done never sees the freed pool.
+	 * Jobs dropped here no longer keep the loop running.
+	 */
+	EVBASE_ACQUIRE_LOCK(pool->base);
+	while ((job = TAILQ_FIRST(&pool->pending)) != NULL) {
+		TAILQ_REMOVE(&pool->pending, job, next);
+		event_del(&job->ev);
+		pool->base->n_pending_jobs--;
+		free(job);
+	}
+	EVBASE_RELEASE_LOCK(pool->base);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+struct evthreadpool *
+evthreadpool_new(struct event_base *base, int nworkers)
+{
+	struct evthreadpool *pool;
+	struct evworker *w;
+	int i;
+
+	if (nworkers < 1 || event_base_use_threads(base) == -1)
+		return (NULL);
+	if ((pool = calloc(1, sizeof(struct evthreadpool))) == NULL)
+		return (NULL);
+	if ((pool->workers = calloc(nworkers, sizeof(struct evworker))) == NULL) {
+		free(pool);
+		return (NULL);
+	}
+	pool->base = base;
+	TAILQ_INIT(&pool->pending);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	/* every deque exists before any worker goes looking for a victim */
+	for (i = 0; i < nworkers; i++) {
+		w = &pool->workers[i];
+		w->pool = pool;
+		w->idx = i;
+		pthread_mutex_init(&w->dq.lock, NULL);
+		w->dq.size = EVDEQUE_INITIAL;
+		if ((w->dq.jobs = malloc(w->dq.size * sizeof(struct evjob *))) == NULL) {
+			pthread_mutex_destroy(&w->dq.lock);
+			break;
+		}
+		pool->nworkers++;
+	}
+	if (pool->nworkers != nworkers) {
+		evthreadpool_destroy(pool, 0);
+		return (NULL);
+	}
+
+	/* pthread_create() publishes nworkers and the deques to each thread */
+	for (i = 0; i < nworkers; i++) {
+		w = &pool->workers[i];
+		if (pthread_create(&w->thread, NULL, evworker_thread, w) != 0) {
+			event_warn("%s: could not start %d workers", __func__,
+			    nworkers);
+			evthreadpool_destroy(pool, i);
+			return (NULL);
+		}
+	}
+	return (pool);
+}
+
+/* Called from the loop thread, typically from inside a callback. */
+int
+evthreadpool_submit(struct evthreadpool *pool,
+    void (*work)(void *), void (*done)(void *), void *arg)
+{
+	struct evjob *job;
+	struct evworker *w;
+
+	if ((job = calloc(1, sizeof(struct evjob))) == NULL)
+		return (-1);
+	job->work = work;
+	job->done = done;
+	job->arg = arg;
+	job->pool = pool;
+	evtimer_set(&job->ev, evjob_done, job);
+	event_base_set(pool->base, &job->ev);
+
+	/* keeps event_base_loop() running until the done callback */
+	EVBASE_ACQUIRE_LOCK(pool->base);
+	TAILQ_INSERT_TAIL(&pool->pending, job, next);
+	pool->base->n_pending_jobs++;
+	EVBASE_RELEASE_LOCK(pool->base);
+
+	w = &pool->workers[pool->next++ % pool->nworkers];
+	if (evdeque_push(&w->dq, job) == -1) {
+		EVBASE_ACQUIRE_LOCK(pool->base);
+		TAILQ_REMOVE(&pool->pending, job, next);
+		pool->base->n_pending_jobs--;
+		EVBASE_RELEASE_LOCK(pool->base);
+		free(job);
+		return (-1);
+	}
+
+	__atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&pool->lock);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	return (0);
+}
+
+void
+evthreadpool_free(struct evthreadpool *pool)
+{
+	evthreadpool_destroy(pool, pool->nworkers);
+}
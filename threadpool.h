@@ -0,0 +1,20 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+struct event_base;
+
+/*
+ * Worker threads for callbacks that would block the loop.  Each worker
+ * has its own deque and steals from the others when it runs dry.  A
+ * job's done callback is activated on the base it was submitted to and
+ * runs on that base's loop thread.
+ */
+struct evthreadpool;
+
+struct evthreadpool *evthreadpool_new(struct event_base *, int nworkers);
+int evthreadpool_submit(struct evthreadpool *,
+    void (*work)(void *), void (*done)(void *), void *arg);
+/* Call once the loop is done; jobs that never ran are dropped. */
+void evthreadpool_free(struct evthreadpool *);
+
+#endif /* _THREADPOOL_H_ */
@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "timewheel.h"
+#include "evutil.h"
+#include "log.h"
+
+#define TW_LEVEL_SHIFT(l)	(TW_ROOT_BITS + (l) * TW_LEVEL_BITS)
+#define TW_LEVEL_SLOT(l, i)	(TW_ROOT_SIZE + (l) * TW_LEVEL_SIZE + (i))
+#define TW_MAX_DELTA		((uint64_t)1 << TW_LEVEL_SHIFT(TW_NLEVELS))
+
+static inline uint64_t
+tick_ceil(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * (1000000 / TW_TICK_USEC) +
+	    (tv->tv_usec + TW_TICK_USEC - 1) / TW_TICK_USEC;
+}
+
+static inline uint64_t
+tick_floor(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * (1000000 / TW_TICK_USEC) +
+	    tv->tv_usec / TW_TICK_USEC;
+}
+
+struct timewheel *
+timewheel_new(const struct timeval *now)
+{
+	struct timewheel *tw;
+	int i;
+
+	if ((tw = calloc(1, sizeof(struct timewheel))) == NULL)
+		return (NULL);
+	for (i = 0; i <= TW_NSLOTS; i++)
+		TAILQ_INIT(&tw->slots[i]);
+	tw->now = tick_floor(now);
+	return (tw);
+}
+
+void
+timewheel_free(struct timewheel *tw)
+{
+	free(tw);
+}
+
+/* File ev into the slot matching its deadline relative to tw->now. */
+static void
+timewheel_insert(struct timewheel *tw, struct event *ev)
+{
+	uint64_t expires = tick_ceil(&ev->ev_timeout);
+	uint64_t delta;
+	unsigned slot;
+	int level;
+
+	if (expires < tw->now)
+		expires = tw->now;
+	delta = expires - tw->now;
+
+	if (delta < TW_ROOT_SIZE) {
+		slot = expires & TW_ROOT_MASK;
+		tw->occupied[slot >> 6] |= (uint64_t)1 << (slot & 63);
+	} else {
+		if (delta >= TW_MAX_DELTA)
+			expires = tw->now + TW_MAX_DELTA - 1;
+		for (level = 0; level < TW_NLEVELS - 1; level++)
+			if (delta < (uint64_t)1 << TW_LEVEL_SHIFT(level + 1))
+				break;
+		slot = TW_LEVEL_SLOT(level,
+		    (expires >> TW_LEVEL_SHIFT(level)) & TW_LEVEL_MASK);
+	}
+
+	TAILQ_INSERT_TAIL(&tw->slots[slot], ev, ev_timeout_next);
+	ev->min_heap_idx = slot;
+}
+
+void
+timewheel_add(struct timewheel *tw, struct event *ev)
+{
+	timewheel_insert(tw, ev);
+	tw->n++;
+}
+
+void
+timewheel_del(struct timewheel *tw, struct event *ev)
+{
+	unsigned slot = ev->min_heap_idx;
+
+	TAILQ_REMOVE(&tw->slots[slot], ev, ev_timeout_next);
+	if (slot < TW_ROOT_SIZE && TAILQ_EMPTY(&tw->slots[slot]))
+		tw->occupied[slot >> 6] &= ~((uint64_t)1 << (slot & 63));
+	ev->min_heap_idx = -1;
+	tw->n--;
+}
+
+/* First occupied root slot at or after idx, TW_ROOT_SIZE if none. */
+static unsigned
+timewheel_next_root(struct timewheel *tw, unsigned idx)
+{
+	unsigned word = idx >> 6;
+	uint64_t bits;
+
+	if (idx >= TW_ROOT_SIZE)
+		return (TW_ROOT_SIZE);
+	bits = tw->occupied[word] & (~(uint64_t)0 << (idx & 63));
+	for (;;) {
+		if (bits)
+			return (word * 64 + __builtin_ctzll(bits));
+		if (++word == TW_ROOT_SIZE / 64)
+			return (TW_ROOT_SIZE);
+		bits = tw->occupied[word];
+	}
+}
+
+/* The root level wrapped: pull the due slot of each upper level down. */
+static void
+timewheel_cascade(struct timewheel *tw)
+{
+	struct timewheel_list *head;
+	struct event *ev;
+	unsigned idx;
+	int level;
+
+	for (level = 0; level < TW_NLEVELS; level++) {
+		idx = (tw->now >> TW_LEVEL_SHIFT(level)) & TW_LEVEL_MASK;
+		head = &tw->slots[TW_LEVEL_SLOT(level, idx)];
+		while ((ev = TAILQ_FIRST(head)) != NULL) {
+			TAILQ_REMOVE(head, ev, ev_timeout_next);
+			timewheel_insert(tw, ev);
+		}
+		if (idx != 0)
+			break;
+	}
+}
+
+void
+timewheel_advance(struct timewheel *tw, const struct timeval *now)
+{
+	uint64_t to = tick_floor(now);
+	struct timewheel_list *head;
+	struct event *ev;
+	unsigned idx, next;
+
+	while (tw->now <= to) {
+		if (tw->n == 0) {
+			tw->now = to + 1;
+			break;
+		}
+
+		idx = tw->now & TW_ROOT_MASK;
+		if (idx == 0)
+			timewheel_cascade(tw);
+
+		/* skip straight to the next occupied slot or level boundary */
+		next = timewheel_next_root(tw, idx);
+		if (tw->now + (next - idx) > to) {
+			tw->now = to + 1;
+			break;
+		}
+		tw->now += next - idx;
+		if (next == TW_ROOT_SIZE)
+			continue;
+
+		head = &tw->slots[next];
+		while ((ev = TAILQ_FIRST(head)) != NULL) {
+			TAILQ_REMOVE(head, ev, ev_timeout_next);
+			TAILQ_INSERT_TAIL(&tw->slots[TW_EXPIRED], ev,
+			    ev_timeout_next);
+			ev->min_heap_idx = TW_EXPIRED;
+		}
+		tw->occupied[next >> 6] &= ~((uint64_t)1 << (next & 63));
+		tw->now++;
+	}
+}
+
+struct event *
+timewheel_first_expired(struct timewheel *tw)
+{
+	return (TAILQ_FIRST(&tw->slots[TW_EXPIRED]));
+}
+
+/* Earliest tick at which an upper level slot is cascaded, 0 if none. */
+static uint64_t
+timewheel_next_cascade(struct timewheel *tw)
+{
+	uint64_t best = 0, base, t;
+	unsigned shift, pos, k;
+	int level;
+
+	for (level = 0; level < TW_NLEVELS; level++) {
+		shift = TW_LEVEL_SHIFT(level);
+		base = (tw->now + ((uint64_t)1 << shift) - 1) >> shift;
+		pos = base & TW_LEVEL_MASK;
+		for (k = 0; k < TW_LEVEL_SIZE; k++) {
+			if (TAILQ_EMPTY(&tw->slots[TW_LEVEL_SLOT(level,
+			    (pos + k) & TW_LEVEL_MASK)]))
+				continue;
+			t = (base + k) << shift;
+			if (best == 0 || t < best)
+				best = t;
+			break;
+		}
+	}
+	return (best);
+}
+
+int
+timewheel_next_timeout(struct timewheel *tw, const struct timeval *now,
+    struct timeval *tv)
+{
+	uint64_t tick = 0, boundary, cascade, usec, nowusec;
+	unsigned idx, next;
+
+	if (tw->n == 0)
+		return (1);
+
+	if (TAILQ_EMPTY(&tw->slots[TW_EXPIRED])) {
+		idx = tw->now & TW_ROOT_MASK;
+		boundary = tw->now - idx + TW_ROOT_SIZE;
+		if ((next = timewheel_next_root(tw, idx)) < TW_ROOT_SIZE)
+			tick = tw->now + (next - idx);
+		else if ((next = timewheel_next_root(tw, 0)) < idx)
+			tick = boundary + next;
+
+		/* anything cascading in before the root's next deadline? */
+		if (tick == 0 || tick >= boundary) {
+			cascade = timewheel_next_cascade(tw);
+			if (cascade && (tick == 0 || cascade < tick))
+				tick = cascade;
+		}
+	}
+
+	usec = tick * TW_TICK_USEC;
+	nowusec = (uint64_t)now->tv_sec * 1000000 + now->tv_usec;
+	if (usec <= nowusec) {
+		evutil_timerclear(tv);
+	} else {
+		usec -= nowusec;
+		tv->tv_sec = usec / 1000000;
+		tv->tv_usec = usec % 1000000;
+	}
+	return (0);
+}
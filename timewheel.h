@@ -0,0 +1,54 @@
+#ifndef _TIMEWHEEL_H_
+#define _TIMEWHEEL_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "event.h"
+
+/*
+ * Hierarchical timing wheel: one 256-slot root level with 1ms ticks and
+ * four 64-slot levels above it, covering 2^32 ticks (about 49 days).
+ * Longer timeouts park in the top level and are re-filed until due.
+ *
+ * Insert and cancel are O(1).  An event on the wheel keeps its slot
+ * number in min_heap_idx, which is unused while the wheel is selected.
+ */
+#define TW_TICK_USEC	1000
+#define TW_ROOT_BITS	8
+#define TW_ROOT_SIZE	(1 << TW_ROOT_BITS)
+#define TW_ROOT_MASK	(TW_ROOT_SIZE - 1)
+#define TW_LEVEL_BITS	6
+#define TW_LEVEL_SIZE	(1 << TW_LEVEL_BITS)
+#define TW_LEVEL_MASK	(TW_LEVEL_SIZE - 1)
+#define TW_NLEVELS	4
+#define TW_NSLOTS	(TW_ROOT_SIZE + TW_NLEVELS * TW_LEVEL_SIZE)
+#define TW_EXPIRED	TW_NSLOTS	/* slot of events due for processing */
+
+TAILQ_HEAD (timewheel_list, event);
+
+struct timewheel {
+	uint64_t now;		/* next tick to process */
+	unsigned n;		/* events on the wheel, expired included */
+	uint64_t occupied[TW_ROOT_SIZE / 64];	/* non-empty root slots */
+	struct timewheel_list slots[TW_NSLOTS + 1];
+};
+
+struct timewheel *timewheel_new(const struct timeval *now);
+void timewheel_free(struct timewheel *);
+
+void timewheel_add(struct timewheel *, struct event *);
+void timewheel_del(struct timewheel *, struct event *);
+
+/* Move every event due at or before now onto the expired slot. */
+void timewheel_advance(struct timewheel *, const struct timeval *now);
+/* First event moved by timewheel_advance(), or NULL. */
+struct event *timewheel_first_expired(struct timewheel *);
+
+/* Time until the wheel needs servicing; returns 1 if it is empty. */
+int timewheel_next_timeout(struct timewheel *, const struct timeval *now,
+    struct timeval *tv);
+
+#define timewheel_size(tw)	((tw)->n)
+
+#endif /* _TIMEWHEEL_H_ */